@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// MorphAssembly Benchmark Harness
+//
+// Runs each workload once under --profile to learn its instruction count,
+// then REPS times plainly, timing wall clock and collecting peak RSS via
+// wait4(). Each workload <name>.bin needs its manifest <name>.chk next to it.
+//
+// Output is one JSON object per line on stdout (and in --save FILE), so a
+// saved run can later be passed back with --compare as the baseline.
+
+#define MAX_WORKLOADS 64
+#define MAX_REPS 1000
+
+typedef struct {
+    char name[64];
+    int reps;
+    int exit_code;
+    uint64_t instructions;
+    uint64_t median_ns, min_ns, max_ns;
+    uint64_t net_ns;            // median_ns minus the startup workload's median
+    long peak_rss_kb;
+} Result;
+
+const char *vm_path;
+Result results[MAX_WORKLOADS];
+int result_count;
+
+void fail(const char *msg, const char *detail) {
+    fprintf(stderr, "Error: %s", msg);
+    if (detail) fprintf(stderr, " '%s'", detail);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Runs the VM once with its output discarded. Returns the exit status and
+// fills in the wall time and peak RSS of the child.
+int run_vm(const char *bin, const char *chk, bool profile, uint64_t *wall_ns, long *rss_kb) {
+    uint64_t t0 = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) fail("fork failed", NULL);
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) { dup2(null, 1); dup2(null, 2); }
+        if (profile) execl(vm_path, vm_path, "--profile", "--manifest", chk, bin, (char *)NULL);
+        else execl(vm_path, vm_path, "--manifest", chk, bin, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) fail("wait4 failed", NULL);
+    *wall_ns = now_ns() - t0;
+    *rss_kb = ru.ru_maxrss;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+uint64_t read_instruction_count(const char *bin) {
+    char path[4096], line[256];
+    snprintf(path, sizeof(path), "%s.prof", bin);
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    uint64_t n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "total_instructions %lu", &n) == 1) break;
+    }
+    fclose(f);
+    remove(path);
+    snprintf(path, sizeof(path), "%s.folded", bin);
+    remove(path);
+    return n;
+}
+
+void bench(const char *bin, int reps, uint64_t startup_ns) {
+    if (result_count == MAX_WORKLOADS) fail("Too many workloads", NULL);
+    Result *r = &results[result_count++];
+    memset(r, 0, sizeof(*r));
+
+    // Name is the file name without directory and extension.
+    const char *base = strrchr(bin, '/');
+    base = base ? base + 1 : bin;
+    snprintf(r->name, sizeof(r->name), "%.*s", (int)strcspn(base, "."), base);
+
+    char chk[4096];
+    size_t stem = strlen(bin);
+    if (stem > 4 && strcmp(bin + stem - 4, ".bin") == 0) stem -= 4;
+    snprintf(chk, sizeof(chk), "%.*s.chk", (int)stem, bin);
+
+    uint64_t wall;
+    long rss;
+    r->exit_code = run_vm(bin, chk, true, &wall, &rss);
+    r->instructions = read_instruction_count(bin);
+
+    uint64_t samples[MAX_REPS];
+    r->reps = reps;
+    for (int i = 0; i < reps; i++) {
+        int code = run_vm(bin, chk, false, &samples[i], &rss);
+        if (code != 0) r->exit_code = code;
+        if (rss > r->peak_rss_kb) r->peak_rss_kb = rss;
+    }
+    qsort(samples, reps, sizeof(uint64_t), cmp_u64);
+    r->min_ns = samples[0];
+    r->max_ns = samples[reps - 1];
+    r->median_ns = samples[reps / 2];
+    r->net_ns = r->median_ns > startup_ns ? r->median_ns - startup_ns : 0;
+}
+
+void print_result(FILE *f, const Result *r) {
+    double ips = r->net_ns ? r->instructions * 1e9 / r->net_ns : 0;
+    double ns_per = r->instructions ? (double)r->net_ns / r->instructions : 0;
+    fprintf(f, "{\"name\":\"%s\",\"reps\":%d,\"exit\":%d,\"instructions\":%lu,\"median_ns\":%lu,\"min_ns\":%lu,\"max_ns\":%lu,"
+               "\"net_ns\":%lu,\"insns_per_sec\":%.0f,\"ns_per_dispatch\":%.3f,\"peak_rss_kb\":%ld}\n",
+            r->name, r->reps, r->exit_code, r->instructions, r->median_ns, r->min_ns, r->max_ns,
+            r->net_ns, ips, ns_per, r->peak_rss_kb);
+}
+
+typedef struct {
+    char name[64];
+    uint64_t median_ns;
+} Baseline;
+
+Baseline baselines[MAX_WORKLOADS];
+int baseline_count;
+
+// Loaded before anything is written, so --save and --compare may name the same file.
+void load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) fail("Could not open baseline", path);
+    char line[1024];
+    while (fgets(line, sizeof(line), f) && baseline_count < MAX_WORKLOADS) {
+        Baseline *b = &baselines[baseline_count];
+        char *m = strstr(line, "\"median_ns\":");
+        if (sscanf(line, "{\"name\":\"%63[^\"]\"", b->name) != 1 || !m || sscanf(m, "\"median_ns\":%lu", &b->median_ns) != 1) continue;
+        baseline_count++;
+    }
+    fclose(f);
+}
+
+// Compares median times against the baseline. Returns the number of
+// workloads that got slower by more than `threshold` percent.
+int compare(double threshold) {
+    int regressions = 0;
+    fprintf(stderr, "\n%-16s %14s %14s %9s\n", "workload", "baseline_ns", "current_ns", "change");
+    for (int b = 0; b < baseline_count; b++) {
+        for (int i = 0; i < result_count; i++) {
+            if (strcmp(results[i].name, baselines[b].name) != 0) continue;
+            uint64_t base_ns = baselines[b].median_ns;
+            double change = base_ns ? 100.0 * ((double)results[i].median_ns - base_ns) / base_ns : 0;
+            bool slower = change > threshold;
+            if (slower) regressions++;
+            fprintf(stderr, "%-16s %14lu %14lu %+8.2f%%%s\n", baselines[b].name, base_ns, results[i].median_ns, change, slower ? "  REGRESSION" : "");
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    int reps = 5;
+    const char *save = NULL, *baseline = NULL;
+    double threshold = 5.0;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) save = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) baseline = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+        else break;
+    }
+    if (argc - i < 2 || reps < 1 || reps > MAX_REPS) {
+        printf("Usage: %s [--reps N] [--save results.json] [--compare baseline.json] [--threshold PCT] <vm> <workload.bin>...\n", argv[0]);
+        return 1;
+    }
+    vm_path = argv[i++];
+    if (baseline) load_baseline(baseline);
+
+    // A workload named "startup" is measured first; its median is the fixed
+    // cost (integrity check, load, exit) subtracted from the others.
+    uint64_t startup_ns = 0;
+    for (int w = i; w < argc; w++) {
+        if (!strstr(argv[w], "startup")) continue;
+        bench(argv[w], reps, 0);
+        startup_ns = results[result_count - 1].median_ns;
+    }
+    for (int w = i; w < argc; w++) {
+        if (!strstr(argv[w], "startup")) bench(argv[w], reps, startup_ns);
+    }
+
+    FILE *out = save ? fopen(save, "w") : NULL;
+    if (save && !out) fail("Could not open output", save);
+    fprintf(stderr, "%-16s %12s %12s %14s %10s %10s\n", "workload", "instructions", "median_ms", "insns/sec", "ns/disp", "rss_kb");
+    int failed = 0;
+    for (int r = 0; r < result_count; r++) {
+        Result *res = &results[r];
+        print_result(stdout, res);
+        if (out) print_result(out, res);
+        fprintf(stderr, "%-16s %12lu %12.3f %14.0f %10.3f %10ld%s\n", res->name, res->instructions, res->median_ns / 1e6,
+                res->net_ns ? res->instructions * 1e9 / res->net_ns : 0, res->instructions ? (double)res->net_ns / res->instructions : 0,
+                res->peak_rss_kb, res->exit_code ? "  FAILED" : "");
+        if (res->exit_code) failed++;
+    }
+    if (out) fclose(out);
+
+    if (baseline && compare(threshold) > 0) return 1;
+    return failed ? 1 : 0;
+}
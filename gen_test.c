@@ -28,58 +28,82 @@
 #define SYS_EXIT  0
 #define SYS_THREAD_EXIT 6
 
-FILE *f;
+// Code is assembled in memory so jump offsets and absolute addresses can be
+// patched once every label is known (see morph_asm.c for the text assembler).
+#define MAX_CODE   4096
+#define MAX_FIXUPS 64
+
+typedef enum { LABEL_WORKER, LABEL_MAIN, LABEL_COUNT } LabelId;
+
+uint8_t code[MAX_CODE];
+uint32_t pc;
+uint32_t labels[LABEL_COUNT];
+
+typedef struct {
+    uint32_t at;      // Operand position in code[]
+    LabelId label;
+    int relative;     // 1: int32 offset from the end of the operand, 0: absolute u64
+} Fixup;
+
+Fixup fixups[MAX_FIXUPS];
+int fixup_count;
 
 void emit_u8(uint8_t v) {
-    fwrite(&v, 1, 1, f);
+    code[pc++] = v;
 }
 
 void emit_u32(uint32_t v) {
-    fwrite(&v, 4, 1, f);
+    for (int i = 0; i < 4; i++) emit_u8((v >> (i * 8)) & 0xFF);
 }
 
 void emit_u64(uint64_t v) {
-    fwrite(&v, 8, 1, f);
+    for (int i = 0; i < 8; i++) emit_u8((v >> (i * 8)) & 0xFF);
+}
+
+void label(LabelId id) {
+    labels[id] = pc;
+}
+
+// JMP/JZ to a label
+void emit_jump(uint8_t op, LabelId target) {
+    emit_u8(op);
+    fixups[fixup_count++] = (Fixup){ pc, target, 1 };
+    emit_u32(0);
+}
+
+// PUSH the absolute address of a label (e.g. for SPAWN)
+void emit_push_label(LabelId target) {
+    emit_u8(OP_PUSH);
+    fixups[fixup_count++] = (Fixup){ pc, target, 0 };
+    emit_u64(0);
+}
+
+void resolve_fixups() {
+    for (int i = 0; i < fixup_count; i++) {
+        Fixup *fx = &fixups[i];
+        uint32_t end = pc;
+        pc = fx->at;
+        if (fx->relative) emit_u32(labels[fx->label] - (fx->at + 4));
+        else emit_u64(labels[fx->label]);
+        pc = end;
+    }
 }
 
 int main() {
-    f = fopen("test.bin", "wb");
+    FILE *f = fopen("test.bin", "wb");
     if (!f) return 1;
 
     printf("Generating final JOIN test with Thread Exit...\n");
 
-    // --- Final Structure ---
-    // 1. Header (8 bytes)
-    // 2. JMP (5 bytes) -> Jumps over worker
-    // 3. Worker (30 bytes)
-    // 4. Main (...)
-
-    // --- Calculate Worker Size ---
-    // PUSH 888, PRINT: 10 bytes
-    // PUSH 999, PRINT: 10 bytes
-    // PUSH SYS_THREAD_EXIT, SYSCALL: 10 bytes
-    // TOTAL Worker: 30 bytes
-
-    // --- Calculate JMP Offset ---
-    // JMP is at file position 8.
-    // After JMP instruction is read, IP will be 8 + 5 = 13.
-    // Worker code starts at 13.
-    // Main code starts at 13 + 30 = 43.
-    // The JMP needs to go from IP=13 to address 43.
-    // Offset = 43 - 13 = 30.
-
-    // --- Generation ---
-    // Header
-    uint32_t magic = 0x4D4F5250;
-    fwrite(&magic, 4, 1, f);
+    // Header (8 bytes). It stays in VM memory, so addresses count from the file start.
+    emit_u32(0x4D4F5250);
     emit_u8(0x01);
     emit_u8(0x00); emit_u8(0x00); emit_u8(0x00);
 
-    // JMP to Main
-    emit_u8(OP_JMP);
-    emit_u32(30); // Jump over the worker code (30 bytes)
+    emit_jump(OP_JMP, LABEL_MAIN); // Jump over the worker code
 
-    // Worker Function (starts at address 13)
+    // Worker Function
+    label(LABEL_WORKER);
     emit_u8(OP_PUSH); emit_u64(888);
     emit_u8(OP_PRINT);
     emit_u8(OP_PUSH); emit_u64(999);
@@ -87,11 +111,12 @@ int main() {
     emit_u8(OP_PUSH); emit_u64(SYS_THREAD_EXIT); // Push syscall ID
     emit_u8(OP_SYSCALL);                         // Exit this thread
 
-    // Main Function (starts at address 43)
+    // Main Function
+    label(LABEL_MAIN);
     emit_u8(OP_PUSH); emit_u64(111); // "Main Start"
     emit_u8(OP_PRINT);
 
-    emit_u8(OP_PUSH); emit_u64(13);  // Worker address
+    emit_push_label(LABEL_WORKER);   // Worker address
     emit_u8(OP_SPAWN);               // Returns child ID
 
     emit_u8(OP_DUP);                 // Dup the ID for printing
@@ -106,6 +131,8 @@ int main() {
     emit_u8(OP_PUSH); emit_u64(SYS_EXIT); // Syscall ID
     emit_u8(OP_SYSCALL);                 // Exit whole VM
 
+    resolve_fixups();
+    fwrite(code, 1, pc, f);
     fclose(f);
     printf("Generated test.bin\n");
     return 0;
@@ -0,0 +1,470 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+
+// MorphAssembly Assembler
+//
+// Source syntax (one statement per line, ';' starts a comment):
+//     .const NAME value      Define a constant (decimal, 0x hex, or another constant)
+//     label:                 Define a label at the next instruction
+//     PUSH 42 | PUSH NAME    Push a number or constant
+//     PUSH label             Push the absolute address of a label (for SPAWN)
+//     JMP label | JZ label   Relative jump, the offset is computed by the assembler
+//     CALL label             Call a subroutine (relative, like JMP)
+//     RET argc               Return, dropping argc arguments and keeping the top value
+//     LOCAL_GET n | LOCAL_SET n   Frame-relative slot, n in -128..127 (arguments < 0)
+//
+// The optimizer (disable with -O0) only knows about label references, so
+// code reached through a numeric address (e.g. "PUSH 13" before SPAWN)
+// must use a label instead.
+//
+// Absolute addresses include the 8-byte header, matching the VM, which keeps
+// the header in memory and starts executing at offset 8.
+
+// Opcode Definitions
+#define OP_NOP    0x00
+#define OP_PUSH   0x01
+#define OP_POP    0x02
+#define OP_ADD    0x03
+#define OP_SUB    0x04
+#define OP_JMP    0x05
+#define OP_JZ     0x06
+#define OP_EQ     0x07
+#define OP_DUP    0x08
+#define OP_PRINT  0x09
+#define OP_LOAD   0x0A
+#define OP_STORE  0x0B
+#define OP_CAS    0x0C
+#define OP_FETCH_ADD 0x0D
+#define OP_BREAK  0x10
+#define OP_SYSCALL 0x11
+#define OP_SPAWN  0x20
+#define OP_YIELD  0x21
+#define OP_JOIN   0x22
+#define OP_SEND   0x23
+#define OP_RECV   0x24
+#define OP_CALL   0x30
+#define OP_RET    0x31
+#define OP_LOCAL_GET 0x32
+#define OP_LOCAL_SET 0x33
+
+// Syscall IDs
+#define SYS_EXIT  0
+#define SYS_THREAD_EXIT 6
+
+#define HEADER_SIZE 8
+#define MAX_NAME 64
+
+typedef struct {
+    const char *name;
+    uint8_t op;
+} Mnemonic;
+
+static const Mnemonic mnemonics[] = {
+    { "NOP", OP_NOP }, { "PUSH", OP_PUSH }, { "POP", OP_POP }, { "ADD", OP_ADD },
+    { "SUB", OP_SUB }, { "JMP", OP_JMP }, { "JZ", OP_JZ }, { "EQ", OP_EQ },
+    { "DUP", OP_DUP }, { "PRINT", OP_PRINT }, { "LOAD", OP_LOAD }, { "STORE", OP_STORE },
+    { "BREAK", OP_BREAK }, { "SYSCALL", OP_SYSCALL }, { "SPAWN", OP_SPAWN },
+    { "YIELD", OP_YIELD }, { "JOIN", OP_JOIN }, { "CALL", OP_CALL }, { "RET", OP_RET },
+    { "LOCAL_GET", OP_LOCAL_GET }, { "LOCAL_SET", OP_LOCAL_SET }, { "CAS", OP_CAS },
+    { "FETCH_ADD", OP_FETCH_ADD }, { "SEND", OP_SEND }, { "RECV", OP_RECV },
+};
+
+typedef struct {
+    uint8_t op;
+    bool dead;
+    uint64_t value;     // Immediate, or raw offset for a branch without a label
+    int label;          // Referenced label (PUSH address / jump target), -1 if none
+    int line;
+} Insn;
+
+typedef struct {
+    char name[MAX_NAME];
+    int target;         // Index of the instruction the label precedes
+    bool defined;
+} Label;
+
+typedef struct {
+    char name[MAX_NAME];
+    uint64_t value;
+} Const;
+
+Insn *insns;
+int insn_count, insn_cap;
+Label *labels;
+int label_count, label_cap;
+bool *referenced;       // Per label: some instruction uses it
+Const *consts;
+int const_count, const_cap;
+int cur_line;
+
+void fail(const char *msg, const char *detail) {
+    if (cur_line) fprintf(stderr, "Error line %d: %s", cur_line, msg);
+    else fprintf(stderr, "Error: %s", msg);
+    if (detail) fprintf(stderr, " '%s'", detail);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+void *grow(void *p, int *cap, size_t elem) {
+    *cap = *cap ? *cap * 2 : 64;
+    p = realloc(p, *cap * elem);
+    if (!p) fail("Memory allocation failed", NULL);
+    return p;
+}
+
+int insn_length(uint8_t op) {
+    switch (op) {
+        case OP_PUSH: return 9;
+        case OP_JMP: case OP_JZ: case OP_CALL: return 5;
+        case OP_RET: case OP_LOCAL_GET: case OP_LOCAL_SET: return 2;
+        default: return 1;
+    }
+}
+
+bool is_branch(uint8_t op) {
+    return op == OP_JMP || op == OP_JZ || op == OP_CALL;
+}
+
+// --- Symbols ---
+
+int find_label(const char *name) {
+    for (int i = 0; i < label_count; i++) {
+        if (strcmp(labels[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+int label_ref(const char *name) {
+    int i = find_label(name);
+    if (i >= 0) return i;
+    if (label_count == label_cap) labels = grow(labels, &label_cap, sizeof(Label));
+    Label *l = &labels[label_count];
+    snprintf(l->name, MAX_NAME, "%s", name);
+    l->target = -1;
+    l->defined = false;
+    return label_count++;
+}
+
+Const *find_const(const char *name) {
+    for (int i = 0; i < const_count; i++) {
+        if (strcmp(consts[i].name, name) == 0) return &consts[i];
+    }
+    return NULL;
+}
+
+void define_const(const char *name, uint64_t value) {
+    if (find_const(name)) fail("Duplicate constant", name);
+    if (const_count == const_cap) consts = grow(consts, &const_cap, sizeof(Const));
+    snprintf(consts[const_count].name, MAX_NAME, "%s", name);
+    consts[const_count++].value = value;
+}
+
+bool parse_number(const char *s, uint64_t *out) {
+    char *end;
+    if (!isdigit((unsigned char)s[0]) && !(s[0] == '-' && isdigit((unsigned char)s[1]))) return false;
+    *out = s[0] == '-' ? (uint64_t)strtoll(s, &end, 0) : strtoull(s, &end, 0);
+    return *end == '\0';
+}
+
+bool parse_value(const char *s, uint64_t *out) {
+    if (parse_number(s, out)) return true;
+    Const *c = find_const(s);
+    if (!c) return false;
+    *out = c->value;
+    return true;
+}
+
+// --- Parser ---
+
+void add_insn(uint8_t op, uint64_t value, int label) {
+    if (insn_count == insn_cap) insns = grow(insns, &insn_cap, sizeof(Insn));
+    insns[insn_count++] = (Insn){ .op = op, .value = value, .label = label, .line = cur_line };
+}
+
+void parse_line(char *line) {
+    char *comment = strchr(line, ';');
+    if (comment) *comment = '\0';
+
+    char *tok[4];
+    int n = 0;
+    for (char *t = strtok(line, " \t\r\n,"); t && n < 4; t = strtok(NULL, " \t\r\n,")) tok[n++] = t;
+    if (n == 0) return;
+
+    // Label definition, possibly followed by an instruction on the same line.
+    size_t len = strlen(tok[0]);
+    if (tok[0][len - 1] == ':') {
+        tok[0][len - 1] = '\0';
+        if (len - 1 >= MAX_NAME || len == 1) fail("Invalid label", tok[0]);
+        int idx = label_ref(tok[0]); // May grow `labels`
+        Label *l = &labels[idx];
+        if (l->defined) fail("Duplicate label", tok[0]);
+        l->defined = true;
+        l->target = insn_count;
+        if (n == 1) return;
+        memmove(tok, tok + 1, (n - 1) * sizeof(char *));
+        n--;
+    }
+
+    if (strcmp(tok[0], ".const") == 0) {
+        uint64_t v;
+        if (n != 3) fail("Usage: .const NAME value", NULL);
+        if (strlen(tok[1]) >= MAX_NAME) fail("Constant name too long", tok[1]);
+        if (!parse_value(tok[2], &v)) fail("Invalid constant value", tok[2]);
+        define_const(tok[1], v);
+        return;
+    }
+
+    for (char *p = tok[0]; *p; p++) *p = toupper((unsigned char)*p);
+    const Mnemonic *m = NULL;
+    for (size_t i = 0; i < sizeof(mnemonics) / sizeof(mnemonics[0]); i++) {
+        if (strcmp(mnemonics[i].name, tok[0]) == 0) { m = &mnemonics[i]; break; }
+    }
+    if (!m) fail("Unknown mnemonic", tok[0]);
+
+    bool has_operand = insn_length(m->op) > 1;
+    if (n > (has_operand ? 2 : 1)) fail("Unexpected operand", tok[0]);
+    if (has_operand && n < 2) fail("Missing operand", tok[0]);
+    if (!has_operand) { add_insn(m->op, 0, -1); return; }
+
+    uint64_t v;
+    if (parse_value(tok[1], &v)) {
+        if (m->op == OP_RET && v > 255) fail("RET argument count out of range", tok[1]);
+        if ((m->op == OP_LOCAL_GET || m->op == OP_LOCAL_SET) && ((int64_t)v < -128 || (int64_t)v > 127)) fail("Local slot out of range", tok[1]);
+        add_insn(m->op, v, -1);
+    } else if (!is_branch(m->op) && m->op != OP_PUSH) {
+        fail("Expected a number", tok[1]);
+    } else {
+        if (strlen(tok[1]) >= MAX_NAME) fail("Label name too long", tok[1]);
+        add_insn(m->op, 0, label_ref(tok[1]));
+    }
+}
+
+// --- Optimizer ---
+
+// Index of the first live instruction at or after i (insn_count if none).
+int next_live(int i) {
+    while (i < insn_count && insns[i].dead) i++;
+    return i;
+}
+
+// Instruction i can be merged into its predecessor only if no jump or
+// SPAWN address can land on it.
+bool is_target(int i) {
+    for (int l = 0; l < label_count; l++) {
+        if (referenced[l] && next_live(labels[l].target) == i) return true;
+    }
+    return false;
+}
+
+bool is_const_push(int i) {
+    return i < insn_count && insns[i].op == OP_PUSH && insns[i].label < 0;
+}
+
+// PUSH a, PUSH b, ADD|SUB|EQ  ->  PUSH result
+// PUSH c, JZ L                ->  JMP L (c == 0) or nothing
+int fold_constants() {
+    int changed = 0;
+    for (int i = next_live(0); i < insn_count; i = next_live(i + 1)) {
+        if (!is_const_push(i)) continue;
+        int j = next_live(i + 1);
+        if (j >= insn_count || is_target(j)) continue;
+
+        if (insns[j].op == OP_JZ) {
+            if (insns[i].value == 0) insns[j].op = OP_JMP;
+            else insns[j].dead = true;
+            insns[i].dead = true;
+            changed++;
+            continue;
+        }
+
+        if (!is_const_push(j)) continue;
+        int k = next_live(j + 1);
+        if (k >= insn_count || is_target(k)) continue;
+        uint64_t a = insns[i].value, b = insns[j].value;
+        switch (insns[k].op) {
+            case OP_ADD: insns[i].value = a + b; break;
+            case OP_SUB: insns[i].value = a - b; break;
+            case OP_EQ:  insns[i].value = a == b ? 1 : 0; break;
+            default: continue;
+        }
+        insns[j].dead = insns[k].dead = true;
+        changed++;
+    }
+    return changed;
+}
+
+// PUSH x, POP  and  DUP, POP  ->  nothing
+int remove_push_pop() {
+    int changed = 0;
+    for (int i = next_live(0); i < insn_count; i = next_live(i + 1)) {
+        if (insns[i].op != OP_PUSH && insns[i].op != OP_DUP) continue;
+        int j = next_live(i + 1);
+        if (j >= insn_count || insns[j].op != OP_POP || is_target(j)) continue;
+        insns[i].dead = insns[j].dead = true;
+        changed++;
+    }
+    return changed;
+}
+
+// Control never falls through JMP, RET, or a SYSCALL whose ID was pushed as
+// SYS_EXIT / SYS_THREAD_EXIT, so everything up to the next target is dead.
+// A SYSCALL that is itself a target may be reached with a different ID.
+bool ends_flow(int i, int prev) {
+    if (insns[i].op == OP_JMP || insns[i].op == OP_RET) return true;
+    if (insns[i].op != OP_SYSCALL || prev < 0 || is_target(i) || !is_const_push(prev)) return false;
+    return insns[prev].value == SYS_EXIT || insns[prev].value == SYS_THREAD_EXIT;
+}
+
+int remove_dead_code() {
+    int changed = 0;
+    int prev = -1;
+    for (int i = next_live(0); i < insn_count; prev = i, i = next_live(i + 1)) {
+        if (!ends_flow(i, prev)) continue;
+        for (int j = next_live(i + 1); j < insn_count && !is_target(j); j = next_live(j + 1)) {
+            insns[j].dead = true;
+            changed++;
+        }
+    }
+    return changed;
+}
+
+// Retarget jumps and calls whose destination is a JMP, and drop jumps to
+// the instruction that follows anyway.
+int thread_jumps() {
+    int changed = 0;
+    for (int i = next_live(0); i < insn_count; i = next_live(i + 1)) {
+        Insn *in = &insns[i];
+        if (!is_branch(in->op) || in->label < 0) continue;
+
+        for (int hops = 0; hops < insn_count; hops++) {
+            int t = next_live(labels[in->label].target);
+            if (t >= insn_count || t == i || insns[t].op != OP_JMP || insns[t].label < 0) break;
+            if (insns[t].label == in->label) break;
+            in->label = insns[t].label;
+            changed++;
+        }
+
+        if (in->op != OP_CALL && next_live(labels[in->label].target) == next_live(i + 1)) {
+            // JZ still has to consume its condition.
+            if (in->op == OP_JZ) { in->op = OP_POP; in->label = -1; }
+            else in->dead = true;
+            changed++;
+        }
+    }
+    return changed;
+}
+
+void optimize() {
+    // Passes only ever drop references or move them to labels that are
+    // already referenced, so this stays a safe over-approximation.
+    referenced = calloc(label_count + 1, sizeof(bool));
+    if (!referenced) fail("Memory allocation failed", NULL);
+    for (int i = 0; i < insn_count; i++) {
+        if (insns[i].label >= 0) referenced[insns[i].label] = true;
+        // A raw jump offset can land anywhere, so nothing may move.
+        if (is_branch(insns[i].op) && insns[i].label < 0) {
+            printf("Warning: raw jump offset on line %d, optimizations disabled\n", insns[i].line);
+            return;
+        }
+    }
+
+    int changed;
+    do {
+        changed = fold_constants();
+        changed += remove_push_pop();
+        changed += thread_jumps();
+        changed += remove_dead_code();
+    } while (changed);
+}
+
+// --- Layout & Emission ---
+
+void emit_le(FILE *f, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) fputc((v >> (i * 8)) & 0xFF, f);
+}
+
+int main(int argc, char *argv[]) {
+    bool opt = true;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "-O0") == 0) { opt = false; argi++; }
+    if (argc - argi != 2) {
+        printf("Usage: %s [-O0] <source.masm> <output.bin>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[argi], "r");
+    if (!in) fail("Could not open source", argv[argi]);
+
+    define_const("SYS_EXIT", SYS_EXIT);
+    define_const("SYS_OPEN", 1);
+    define_const("SYS_CLOSE", 2);
+    define_const("SYS_READ", 3);
+    define_const("SYS_WRITE", 4);
+    define_const("SYS_SBRK", 5);
+    define_const("SYS_THREAD_EXIT", SYS_THREAD_EXIT);
+    define_const("SYS_CHAN_OPEN", 7);
+    define_const("SYS_CHAN_CLOSE", 8);
+
+    char line[512];
+    while (fgets(line, sizeof(line), in)) {
+        cur_line++;
+        parse_line(line);
+    }
+    fclose(in);
+    cur_line = 0;
+
+    for (int l = 0; l < label_count; l++) {
+        if (!labels[l].defined) fail("Undefined label", labels[l].name);
+    }
+
+    int before_count = insn_count;
+    uint64_t before_size = 0;
+    for (int i = 0; i < insn_count; i++) before_size += insn_length(insns[i].op);
+
+    if (opt) optimize();
+
+    // addr[i] is the address of instruction i, or of the next live one if
+    // i was removed, so labels on removed instructions stay valid.
+    uint64_t *addr = malloc((insn_count + 1) * sizeof(uint64_t));
+    if (!addr) fail("Memory allocation failed", NULL);
+    uint64_t pc = HEADER_SIZE;
+    int live = 0;
+    for (int i = 0; i < insn_count; i++) {
+        addr[i] = pc;
+        if (!insns[i].dead) { pc += insn_length(insns[i].op); live++; }
+    }
+    addr[insn_count] = pc;
+
+    FILE *out = fopen(argv[argi + 1], "wb");
+    if (!out) fail("Could not open output", argv[argi + 1]);
+
+    // Header: magic "MORP", version 1, reserved
+    emit_le(out, 0x4D4F5250, 4);
+    emit_le(out, 0x01, 4);
+
+    for (int i = 0; i < insn_count; i++) {
+        Insn *n = &insns[i];
+        if (n->dead) continue;
+        fputc(n->op, out);
+        uint64_t target = n->label >= 0 ? addr[labels[n->label].target] : 0;
+        if (n->op == OP_PUSH) {
+            emit_le(out, n->label >= 0 ? target : n->value, 8);
+        } else if (n->op == OP_RET || n->op == OP_LOCAL_GET || n->op == OP_LOCAL_SET) {
+            fputc(n->value & 0xFF, out);
+        } else if (is_branch(n->op)) {
+            // Offsets are relative to the IP after the operand.
+            int64_t off = n->label >= 0 ? (int64_t)(target - (addr[i] + 5)) : (int64_t)n->value;
+            if (off < INT32_MIN || off > INT32_MAX) { cur_line = n->line; fail("Jump out of range", NULL); }
+            emit_le(out, (uint32_t)(int32_t)off, 4);
+        }
+    }
+    fclose(out);
+
+    printf("Assembled %s: %d -> %d instructions, %lu -> %lu bytes\n", argv[argi + 1], before_count, live, before_size + HEADER_SIZE, pc);
+    free(addr);
+    return 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -6,12 +7,19 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <time.h>
+#include <stdatomic.h>
 #include "sha256.h"
 
 // MorphAssembly VM v0.6
 
 #define STACK_SIZE 1024
+#define CALL_DEPTH 256
 #define MAX_CONTEXTS 16
+#define MAX_CHANNELS 256
+#define CHAN_CAPACITY_MAX 65536
 
 // Opcode Definitions
 #define OP_NOP    0x00
@@ -26,11 +34,20 @@
 #define OP_PRINT  0x09
 #define OP_LOAD   0x0A
 #define OP_STORE  0x0B
+#define OP_CAS    0x0C
+#define OP_FETCH_ADD 0x0D
 #define OP_BREAK  0x10
 #define OP_SYSCALL 0x11
 #define OP_SPAWN  0x20
 #define OP_YIELD  0x21
 #define OP_JOIN   0x22
+#define OP_SEND   0x23
+#define OP_RECV   0x24
+#define OP_CALL   0x30
+#define OP_RET    0x31
+#define OP_LOCAL_GET 0x32
+#define OP_LOCAL_SET 0x33
+#define OP_TRAP   0xFF // Internal: patched over an instruction by the debugger, never emitted
 
 // Syscall IDs
 #define SYS_EXIT  0
@@ -40,41 +57,191 @@
 #define SYS_WRITE 4
 #define SYS_SBRK  5
 #define SYS_THREAD_EXIT 6
+#define SYS_CHAN_OPEN  7
+#define SYS_CHAN_CLOSE 8
+#define SYS_MAX   9
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
 
 // Context State
 typedef enum {
     CONTEXT_UNUSED,
     CONTEXT_ACTIVE,
     CONTEXT_JOINING,
+    CONTEXT_SENDING,    // Parked on a full channel
+    CONTEXT_RECEIVING,  // Parked on an empty channel
 } ContextStatus;
 
+// Call Frame (return stack entry)
+typedef struct {
+    uint64_t ret_ip;
+    uint64_t saved_fp;  // Caller's frame pointer
+    uint32_t prof_node; // Caller's profiler call-path node (instrumented loop only)
+} Frame;
+
 // Context Structure
 typedef struct {
     uint64_t ip;
     uint64_t stack[STACK_SIZE];
     uint64_t sp;
+    uint64_t fp;        // Stack index of the current frame's first local; arguments sit below it
+    Frame frames[CALL_DEPTH];
+    uint64_t fsp;
+    uint32_t prof_node;
     ContextStatus status;
     int joining_on_id; // ID of the context this context is waiting for.
+    uint64_t chan_id;   // Channel a SENDING/RECEIVING context is parked on
+    uint64_t chan_value; // Value a SENDING context is waiting to deliver
+    uint64_t wait_ticket; // Park order, so waiters are served first come first served
 } Context;
 
+// Bounded Channel (ring buffer of values)
+typedef struct {
+    uint64_t *buf;
+    uint32_t cap, head, count;
+    bool used, closed;
+    uint64_t gen;       // Bumped when the slot is released; older IDs read as closed
+} Channel;
+
 // VM State
 typedef struct {
     uint8_t *code;
     size_t code_size;
 
-    // Global Memory
+    // Debugger: pristine copy of the code, allocated once something is patched
+    uint8_t *shadow;
+
+    // Global Memory (mmap'd so the debugger can page-protect it)
     uint8_t *heap;
     size_t heap_capacity;
+    size_t heap_mapped;
 
     // Scheduler
     Context contexts[MAX_CONTEXTS];
     int current_context_id;
     int active_count;
+
+    // Channels (ID = generation * MAX_CHANNELS + slot)
+    Channel channels[MAX_CHANNELS];
+    uint64_t wait_ticket;
 } VM;
 
+// Profiler call-path node: one per distinct chain of CALLs from a context
+// entry, i.e. a calling-context tree.
+#define NO_NODE UINT32_MAX
+
+typedef struct {
+    uint64_t func;          // Callee entry address (context entry for roots)
+    uint32_t parent;        // NO_NODE for roots
+    uint64_t calls;
+    uint64_t *op_self;      // Instructions executed directly on this path, per opcode
+} CallNode;
+
+// Profiler State (only touched by the instrumented loop)
+typedef struct {
+    CallNode *nodes;
+    uint32_t node_count, node_cap;
+    uint32_t *node_index;           // Open-addressed (parent, func) -> node
+    uint32_t index_cap;
+    uint64_t op_count[256];
+    uint64_t *ip_count;             // Hit count per code byte, indexed by IP.
+    uint64_t ctx_insns[MAX_CONTEXTS];
+    uint64_t sys_count[SYS_MAX];
+    uint64_t sys_ns[SYS_MAX];
+    uint64_t start_ns;
+    const char *out_base;           // Report paths are <out_base>.prof and <out_base>.folded
+    bool written;
+} Profile;
+
+// Trace Events (binary layout shared with trace_decode.c)
+#define TRACE_MAGIC     0x4352544D // "MTRC"
+#define TRACE_VERSION   1
+#define TRACE_RING_SIZE 65536      // Events per context, must be a power of two
+
+typedef enum {
+    TRACE_SWITCH = 1,   // a = next context
+    TRACE_SPAWN,        // a = child context, b = entry address
+    TRACE_JOIN,         // a = awaited context
+    TRACE_WAKE,         // a = context woken by this one finishing
+    TRACE_EXIT,         // Context finished
+    TRACE_SYSCALL,      // a = latency ns, b = syscall id, ts = start
+    TRACE_SBRK,         // a = old break, b = increment
+    TRACE_SAMPLE,       // a = IP
+    TRACE_BLOCK,        // a = channel, b = 0 on send, 1 on receive
+} TraceType;
+
+typedef struct {
+    uint64_t ts;        // ns since trace start
+    uint64_t a;
+    uint32_t b;
+    uint8_t type;
+    uint8_t ctx;
+    uint16_t reserved;
+} TraceEvent;
+
+// Single-producer ring per context: the slot is filled before head is
+// published, so a reader never observes a half-written event.
+typedef struct {
+    TraceEvent *events;
+    _Atomic uint64_t head;          // Total events ever written
+} TraceRing;
+
+typedef struct {
+    TraceRing rings[MAX_CONTEXTS];
+    uint64_t start_ns;
+    uint64_t sample_period;         // Record the IP every N instructions (0 = off)
+    uint64_t sample_tick;
+    const char *out_base;           // Dump path is <out_base>.trace
+    bool written;
+} Trace;
+
+// Debugger State
+#define MAX_BREAKPOINTS 32
+#define MAX_WATCHPOINTS 8
+#define NO_TRAP UINT64_MAX
+
+typedef enum { COND_NONE, COND_TOP, COND_SP, COND_CTX, COND_DEPTH, COND_MEM } CondLhs;
+typedef enum { CMP_EQ, CMP_NE, CMP_LT, CMP_GT, CMP_LE, CMP_GE } CondCmp;
+
+typedef struct {
+    bool used;
+    uint64_t addr;
+    uint64_t hits;
+    uint64_t min_hits;      // Stop only from this hit on (0 = every hit)
+    CondLhs lhs;
+    uint64_t lhs_addr;      // Heap address for COND_MEM
+    CondCmp cmp;
+    uint64_t value;
+} Breakpoint;
+
+typedef struct {
+    bool used;
+    uint64_t addr;
+    uint64_t len;
+    bool reads;             // Also trap loads (PROT_NONE instead of PROT_READ)
+    uint64_t hits;
+} Watchpoint;
+
+typedef struct {
+    Breakpoint bps[MAX_BREAKPOINTS];
+    Watchpoint wps[MAX_WATCHPOINTS];
+    int watch_count;
+    uint64_t step_trap_ip;          // One-shot trap armed after a watched access
+    uint64_t resume_ip;             // Trap already reported, execute it on re-entry
+    volatile sig_atomic_t watch_pending;
+    volatile sig_atomic_t watch_hit;        // Index of the hit watchpoint, -1 if none
+    volatile uint64_t watch_hit_addr;
+    size_t page_size;
+} Debugger;
+
 VM vm;
+Profile prof;
+Debugger dbg = { .step_trap_ip = NO_TRAP, .resume_ip = NO_TRAP, .watch_hit = -1 };
+Trace trace;
 bool debug_mode = false;
 bool step_mode = false;
+bool profile_mode = false;
+bool trace_mode = false;
 
 void crash_report(const char *reason, const char *detail) {
     fprintf(stderr, "\n[KEGAGALAN KRITIS] Pengecekan Integritas Gagal!\n");
@@ -84,10 +251,10 @@ void crash_report(const char *reason, const char *detail) {
     exit(1);
 }
 
-void verify_integrity(const char *bin_filename) {
+void verify_integrity(const char *bin_filename, const char *manifest) {
     // 1. Baca Manifest
-    FILE *f_chk = fopen("integrity.chk", "rb");
-    if (!f_chk) crash_report("Manifest Hilang", "File 'integrity.chk' tidak ditemukan.");
+    FILE *f_chk = fopen(manifest, "rb");
+    if (!f_chk) crash_report("Manifest Hilang", manifest);
 
     uint8_t expected_src_hash[32];
     uint8_t expected_bin_hash[32];
@@ -158,6 +325,406 @@ uint64_t peek() {
     return c->stack[c->sp - 1];
 }
 
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Opcode at `ip` as emitted, looking through debugger patches.
+uint8_t code_at(uint64_t ip) {
+    return vm.shadow ? vm.shadow[ip] : vm.code[ip];
+}
+
+int insn_length(uint8_t op) {
+    switch (op) {
+        case OP_PUSH: return 9;
+        case OP_JMP: case OP_JZ: case OP_CALL: return 5;
+        case OP_RET: case OP_LOCAL_GET: case OP_LOCAL_SET: return 2;
+        default: return 1;
+    }
+}
+
+int32_t read_i32(uint64_t at) {
+    int32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= ((uint32_t)vm.code[at + i]) << (i * 8);
+    return v;
+}
+
+const char* op_name(uint8_t op) {
+    switch (op) {
+        case OP_NOP: return "NOP";
+        case OP_PUSH: return "PUSH";
+        case OP_POP: return "POP";
+        case OP_ADD: return "ADD";
+        case OP_SUB: return "SUB";
+        case OP_JMP: return "JMP";
+        case OP_JZ: return "JZ";
+        case OP_EQ: return "EQ";
+        case OP_DUP: return "DUP";
+        case OP_PRINT: return "PRINT";
+        case OP_LOAD: return "LOAD";
+        case OP_STORE: return "STORE";
+        case OP_CAS: return "CAS";
+        case OP_FETCH_ADD: return "FETCH_ADD";
+        case OP_BREAK: return "BREAK";
+        case OP_SYSCALL: return "SYSCALL";
+        case OP_SPAWN: return "SPAWN";
+        case OP_YIELD: return "YIELD";
+        case OP_JOIN: return "JOIN";
+        case OP_SEND: return "SEND";
+        case OP_RECV: return "RECV";
+        case OP_CALL: return "CALL";
+        case OP_RET: return "RET";
+        case OP_LOCAL_GET: return "LOCAL_GET";
+        case OP_LOCAL_SET: return "LOCAL_SET";
+        case OP_TRAP: return "TRAP";
+        default: return "???";
+    }
+}
+
+const char* sys_name(uint64_t id) {
+    static const char *names[SYS_MAX] = { "EXIT", "OPEN", "CLOSE", "READ", "WRITE", "SBRK", "THREAD_EXIT", "CHAN_OPEN", "CHAN_CLOSE" };
+    return id < SYS_MAX ? names[id] : "???";
+}
+
+// Bytecode Verifier
+// Walks the code once before execution: every opcode must be known and
+// complete, and every JMP/JZ/CALL must land on an instruction start (or,
+// for jumps, exactly on the end of the code, which ends the context).
+void verify_code() {
+    char msg[128];
+    uint8_t *starts = calloc(vm.code_size + 1, 1);
+    if (!starts) error("Memory allocation failed");
+
+    for (uint64_t ip = 8; ip < vm.code_size; ip += insn_length(vm.code[ip])) {
+        uint8_t op = vm.code[ip];
+        if (op == OP_TRAP || strcmp(op_name(op), "???") == 0) {
+            snprintf(msg, sizeof(msg), "Opcode tidak dikenal 0x%02X di IP %lu", op, ip);
+            crash_report("Bytecode Tidak Valid", msg);
+        }
+        if (ip + insn_length(op) > vm.code_size) {
+            snprintf(msg, sizeof(msg), "Operand %s terpotong di IP %lu", op_name(op), ip);
+            crash_report("Bytecode Tidak Valid", msg);
+        }
+        starts[ip] = 1;
+    }
+    starts[vm.code_size] = 1;
+
+    for (uint64_t ip = 8; ip < vm.code_size; ip += insn_length(vm.code[ip])) {
+        uint8_t op = vm.code[ip];
+        if (op != OP_JMP && op != OP_JZ && op != OP_CALL) continue;
+        int64_t target = (int64_t)ip + 5 + read_i32(ip + 1);
+        if (target < 8 || target > (int64_t)vm.code_size || !starts[target] || (op == OP_CALL && target == (int64_t)vm.code_size)) {
+            snprintf(msg, sizeof(msg), "Target %s di IP %lu tidak valid (%ld)", op_name(op), ip, target);
+            crash_report("Bytecode Tidak Valid", msg);
+        }
+    }
+    free(starts);
+}
+
+// Profiler
+uint32_t *cct_slot(uint32_t parent, uint64_t func) {
+    uint64_t h = (func * 0x9E3779B97F4A7C15ull) ^ parent;
+    for (uint32_t i = h & (prof.index_cap - 1);; i = (i + 1) & (prof.index_cap - 1)) {
+        uint32_t n = prof.node_index[i];
+        if (n == NO_NODE || (prof.nodes[n].parent == parent && prof.nodes[n].func == func)) return &prof.node_index[i];
+    }
+}
+
+// Returns the node for calling `func` from `parent`, creating it on first use.
+uint32_t cct_node(uint32_t parent, uint64_t func) {
+    uint32_t *slot = cct_slot(parent, func);
+    if (*slot != NO_NODE) return *slot;
+
+    if (prof.node_count == prof.node_cap) {
+        prof.node_cap *= 2;
+        prof.nodes = realloc(prof.nodes, prof.node_cap * sizeof(CallNode));
+        if (!prof.nodes) error("Memory allocation failed");
+    }
+    uint32_t n = prof.node_count++;
+    prof.nodes[n] = (CallNode){ .func = func, .parent = parent };
+    prof.nodes[n].op_self = calloc(256, sizeof(uint64_t));
+    if (!prof.nodes[n].op_self) error("Memory allocation failed");
+    *slot = n;
+
+    // Keep the index at most half full.
+    if (prof.node_count * 2 > prof.index_cap) {
+        free(prof.node_index);
+        prof.index_cap *= 2;
+        prof.node_index = malloc(prof.index_cap * sizeof(uint32_t));
+        if (!prof.node_index) error("Memory allocation failed");
+        memset(prof.node_index, 0xFF, prof.index_cap * sizeof(uint32_t));
+        for (uint32_t i = 0; i < prof.node_count; i++) *cct_slot(prof.nodes[i].parent, prof.nodes[i].func) = i;
+    }
+    return n;
+}
+
+void profile_init(const char *out_base) {
+    memset(&prof, 0, sizeof(prof));
+    prof.ip_count = calloc(vm.code_size, sizeof(uint64_t));
+    prof.node_cap = 64;
+    prof.nodes = malloc(prof.node_cap * sizeof(CallNode));
+    prof.index_cap = 128;
+    prof.node_index = malloc(prof.index_cap * sizeof(uint32_t));
+    if (!prof.ip_count || !prof.nodes || !prof.node_index) error("Memory allocation failed");
+    memset(prof.node_index, 0xFF, prof.index_cap * sizeof(uint32_t));
+    prof.out_base = out_base;
+    prof.start_ns = now_ns();
+    vm.contexts[0].prof_node = cct_node(NO_NODE, vm.contexts[0].ip);
+}
+
+void frame_name(char *buf, size_t len, const CallNode *n) {
+    if (n->parent != NO_NODE) snprintf(buf, len, "fn@%lu", n->func);
+    else if (n->func == 8) snprintf(buf, len, "main");
+    else snprintf(buf, len, "thread@%lu", n->func);
+}
+
+// Writes the text report and a collapsed-stack file (one "frame;frame count"
+// line per call path and opcode) that flamegraph.pl / speedscope accept directly.
+void profile_write() {
+    if (!profile_mode || prof.written) return;
+    prof.written = true;
+
+    uint64_t wall = now_ns() - prof.start_ns;
+    uint64_t total = 0;
+    for (int i = 0; i < 256; i++) total += prof.op_count[i];
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.prof", prof.out_base);
+    FILE *f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "Profiler: cannot write %s\n", path); return; }
+
+    fprintf(f, "# MorphAssembly Profile\n");
+    fprintf(f, "total_instructions %lu\n", total);
+    fprintf(f, "wall_ns %lu\n", wall);
+
+    fprintf(f, "\n[opcodes] name count percent\n");
+    for (int i = 0; i < 256; i++) {
+        if (!prof.op_count[i]) continue;
+        fprintf(f, "%-8s %12lu %6.2f%%\n", op_name(i), prof.op_count[i], 100.0 * prof.op_count[i] / total);
+    }
+
+    fprintf(f, "\n[contexts] id instructions\n");
+    for (int i = 0; i < MAX_CONTEXTS; i++) {
+        if (prof.ctx_insns[i]) fprintf(f, "ctx%-5d %12lu\n", i, prof.ctx_insns[i]);
+    }
+
+    fprintf(f, "\n[syscalls] name calls total_ns avg_ns\n");
+    for (int i = 0; i < SYS_MAX; i++) {
+        if (!prof.sys_count[i]) continue;
+        fprintf(f, "%-12s %10lu %12lu %10lu\n", sys_name(i), prof.sys_count[i], prof.sys_ns[i], prof.sys_ns[i] / prof.sys_count[i]);
+    }
+
+    // Per function: how often it was called, what ran directly in it (self)
+    // and in it plus everything it called (total). Children are always created
+    // after their parent, so one reverse sweep rolls the subtrees up.
+    uint64_t *incl = calloc(prof.node_count, sizeof(uint64_t));
+    if (!incl) error("Memory allocation failed");
+    for (uint32_t i = 0; i < prof.node_count; i++) {
+        for (int op = 0; op < 256; op++) incl[i] += prof.nodes[i].op_self[op];
+    }
+    for (uint32_t i = prof.node_count; i-- > 0;) {
+        if (prof.nodes[i].parent != NO_NODE) incl[prof.nodes[i].parent] += incl[i];
+    }
+    fprintf(f, "\n[functions] entry calls self_instructions total_instructions\n");
+    for (uint32_t i = 0; i < prof.node_count; i++) {
+        CallNode *n = &prof.nodes[i];
+        bool seen = false;
+        for (uint32_t j = 0; j < i && !seen; j++) seen = prof.nodes[j].func == n->func && (prof.nodes[j].parent == NO_NODE) == (n->parent == NO_NODE);
+        if (seen) continue;
+        uint64_t calls = 0, self = 0, sum = 0;
+        for (uint32_t j = i; j < prof.node_count; j++) {
+            CallNode *m = &prof.nodes[j];
+            if (m->func != n->func || (m->parent == NO_NODE) != (n->parent == NO_NODE)) continue;
+            calls += m->calls;
+            for (int op = 0; op < 256; op++) self += m->op_self[op];
+            // A recursive activation is already inside an outer one's total.
+            bool nested = false;
+            for (uint32_t up = m->parent; up != NO_NODE && !nested; up = prof.nodes[up].parent) {
+                nested = prof.nodes[up].func == m->func && prof.nodes[up].parent != NO_NODE;
+            }
+            if (!nested) sum += incl[j];
+        }
+        char name[64];
+        frame_name(name, sizeof(name), n);
+        fprintf(f, "%-16s %10lu %14lu %14lu\n", name, calls, self, sum);
+    }
+    free(incl);
+
+    fprintf(f, "\n[ips] ip opcode count\n");
+    for (size_t ip = 0; ip < vm.code_size; ip++) {
+        if (prof.ip_count[ip]) fprintf(f, "%-8zu %-8s %12lu\n", ip, op_name(code_at(ip)), prof.ip_count[ip]);
+    }
+    fclose(f);
+
+    snprintf(path, sizeof(path), "%s.folded", prof.out_base);
+    f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "Profiler: cannot write %s\n", path); return; }
+    uint32_t chain[CALL_DEPTH + 1];
+    for (uint32_t i = 0; i < prof.node_count; i++) {
+        int depth = 0;
+        for (uint32_t n = i; n != NO_NODE && depth <= CALL_DEPTH; n = prof.nodes[n].parent) chain[depth++] = n;
+        char stack[4096];
+        size_t len = 0;
+        for (int d = depth - 1; d >= 0; d--) {
+            char name[64];
+            frame_name(name, sizeof(name), &prof.nodes[chain[d]]);
+            len += snprintf(stack + len, sizeof(stack) - len, "%s;", name);
+            if (len >= sizeof(stack)) { len = sizeof(stack) - 1; break; }
+        }
+        for (int op = 0; op < 256; op++) {
+            if (prof.nodes[i].op_self[op]) fprintf(f, "%s%s %lu\n", stack, op_name(op), prof.nodes[i].op_self[op]);
+        }
+    }
+    fclose(f);
+
+    fprintf(stderr, "[Profiler] %lu instructions, report: %s.prof, %s.folded\n", total, prof.out_base, prof.out_base);
+}
+
+// Tracer
+void trace_init(const char *out_base) {
+    trace.out_base = out_base;
+    trace.start_ns = now_ns();
+}
+
+void trace_emit(int ctx_id, uint8_t type, uint64_t a, uint32_t b, uint64_t ts) {
+    TraceRing *r = &trace.rings[ctx_id];
+    if (!r->events) {
+        r->events = malloc(TRACE_RING_SIZE * sizeof(TraceEvent));
+        if (!r->events) error("Memory allocation failed");
+    }
+    uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    TraceEvent *e = &r->events[h & (TRACE_RING_SIZE - 1)];
+    e->ts = ts - trace.start_ns;
+    e->a = a;
+    e->b = b;
+    e->type = type;
+    e->ctx = (uint8_t)ctx_id;
+    e->reserved = 0;
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+// Dump layout: header {magic, version, event size, context count}, then per
+// context {u32 id, u64 total written, u64 kept, kept events oldest first}.
+void trace_write() {
+    if (!trace_mode || trace.written) return;
+    trace.written = true;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.trace", trace.out_base);
+    FILE *f = fopen(path, "wb");
+    if (!f) { fprintf(stderr, "Tracer: cannot write %s\n", path); return; }
+
+    uint32_t hdr[4] = { TRACE_MAGIC, TRACE_VERSION, sizeof(TraceEvent), MAX_CONTEXTS };
+    fwrite(hdr, sizeof(hdr), 1, f);
+    uint64_t dropped = 0;
+    for (uint32_t i = 0; i < MAX_CONTEXTS; i++) {
+        TraceRing *r = &trace.rings[i];
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        uint64_t kept = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+        dropped += head - kept;
+        fwrite(&i, 4, 1, f);
+        fwrite(&head, 8, 1, f);
+        fwrite(&kept, 8, 1, f);
+        for (uint64_t n = head - kept; n < head; n++) fwrite(&r->events[n & (TRACE_RING_SIZE - 1)], sizeof(TraceEvent), 1, f);
+    }
+    fclose(f);
+
+    fprintf(stderr, "[Tracer] trace: %s (%lu events overwritten)\n", path, dropped);
+}
+
+// Wakes every context joining on `id` once it has finished.
+void wake_joiners(int id) {
+    for (int i = 0; i < MAX_CONTEXTS; i++) {
+        if (vm.contexts[i].status == CONTEXT_JOINING && vm.contexts[i].joining_on_id == id) {
+            vm.contexts[i].status = CONTEXT_ACTIVE; // Wake up the waiting context
+            vm.contexts[i].joining_on_id = -1; // Clear the join target
+            if (trace_mode) trace_emit(id, TRACE_WAKE, i, 0, now_ns());
+        }
+    }
+}
+
+// Channels
+// A context that cannot make progress is parked (SENDING/RECEIVING) and
+// skipped by the scheduler. Whoever later changes the channel hands the
+// value over directly and wakes it, so a woken context never retries.
+// Live channel for `id`, or NULL if it was closed, drained and released.
+Channel* chan_get(uint64_t id) {
+    Channel *ch = &vm.channels[id % MAX_CHANNELS];
+    uint64_t gen = id / MAX_CHANNELS;
+    if (gen < ch->gen) return NULL;
+    if (gen > ch->gen || !ch->used) error("Invalid Channel");
+    return ch;
+}
+
+// A closed channel has no waiters left, so once drained its slot is free.
+void chan_release_if_done(Channel *ch) {
+    if (!ch->closed || ch->count) return;
+    free(ch->buf);
+    ch->buf = NULL;
+    ch->used = ch->closed = false;
+    ch->head = 0;
+    ch->gen++;
+}
+
+// Oldest context parked on channel `id` with status `st`, or -1.
+int chan_waiter(uint64_t id, ContextStatus st) {
+    int found = -1;
+    for (int i = 0; i < MAX_CONTEXTS; i++) {
+        Context *c = &vm.contexts[i];
+        if (c->status != st || c->chan_id != id) continue;
+        if (found < 0 || c->wait_ticket < vm.contexts[found].wait_ticket) found = i;
+    }
+    return found;
+}
+
+void chan_park(Context *ctx, uint64_t id, ContextStatus st) {
+    ctx->status = st;
+    ctx->chan_id = id;
+    ctx->wait_ticket = vm.wait_ticket++;
+    if (trace_mode) trace_emit(vm.current_context_id, TRACE_BLOCK, id, st == CONTEXT_RECEIVING, now_ns());
+}
+
+void chan_wake(int id) {
+    vm.contexts[id].status = CONTEXT_ACTIVE;
+    if (trace_mode) trace_emit(vm.current_context_id, TRACE_WAKE, id, 0, now_ns());
+}
+
+// Completes the RECV a parked context is blocked in: pushes value and ok flag.
+void chan_deliver(int id, uint64_t value, uint64_t ok) {
+    Context *c = &vm.contexts[id];
+    if (c->sp + 2 > STACK_SIZE) error("Stack Overflow");
+    c->stack[c->sp++] = value;
+    c->stack[c->sp++] = ok;
+    chan_wake(id);
+}
+
+uint64_t chan_open(uint64_t cap) {
+    if (cap == 0 || cap > CHAN_CAPACITY_MAX) error("Invalid Channel Capacity");
+    int slot = -1;
+    for (int i = 0; i < MAX_CHANNELS; i++) {
+        if (!vm.channels[i].used) { slot = i; break; }
+    }
+    if (slot == -1) error("Max Channels Exceeded");
+    Channel *ch = &vm.channels[slot];
+    ch->buf = malloc(cap * sizeof(uint64_t));
+    if (!ch->buf) error("Memory allocation failed");
+    ch->cap = (uint32_t)cap;
+    ch->used = true;
+    return ch->gen * MAX_CHANNELS + slot;
+}
+
+// Wakes every receiver with (0, 0). Parked senders have nowhere to go.
+void chan_close(uint64_t id) {
+    Channel *ch = chan_get(id);
+    if (!ch || ch->closed) error("Channel Already Closed");
+    ch->closed = true;
+    if (chan_waiter(id, CONTEXT_SENDING) >= 0) error("Send on Closed Channel");
+    for (int r; (r = chan_waiter(id, CONTEXT_RECEIVING)) >= 0;) chan_deliver(r, 0, 0);
+    chan_release_if_done(ch);
+}
+
 // Scheduler
 void schedule() {
     int start = vm.current_context_id;
@@ -166,6 +733,7 @@ void schedule() {
     while (next != start) {
         // Find the next active, non-joining context
         if (vm.contexts[next].status == CONTEXT_ACTIVE) {
+            if (trace_mode) trace_emit(start, TRACE_SWITCH, next, 0, now_ns());
             vm.current_context_id = next;
             return;
         }
@@ -175,17 +743,310 @@ void schedule() {
     // If no other context is found, check if the current one is still active.
     // If not, it means all contexts are either unused or joining, which could be a deadlock or program end.
     if (vm.contexts[start].status != CONTEXT_ACTIVE) {
+        // Nobody is left to change the channel a parked context waits on.
+        for (int i = 0; i < MAX_CONTEXTS; i++) {
+            ContextStatus st = vm.contexts[i].status;
+            if (st == CONTEXT_SENDING || st == CONTEXT_RECEIVING) error("Deadlock: all contexts blocked on channels");
+        }
         // For now, if the current thread isn't active, we assume it's the end.
         // A more complex scheduler would check for deadlocks (all threads joining).
         exit(0);
     }
 }
 
+// Heap
+// Grows the heap by `inc` bytes. The mapping is page-granular, so growth
+// inside the last page is free and watchpoint protection can be applied.
+void heap_grow(uint64_t inc) {
+    size_t need = (vm.heap_capacity + inc + dbg.page_size - 1) & ~(dbg.page_size - 1);
+    if (need > vm.heap_mapped) {
+        uint8_t *n = vm.heap
+            ? mremap(vm.heap, vm.heap_mapped, need, MREMAP_MAYMOVE)
+            : mmap(NULL, need, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (n == MAP_FAILED) error("SBRK Fail");
+        vm.heap = n;
+        vm.heap_mapped = need;
+    }
+    vm.heap_capacity += inc;
+}
+
+void ensure_shadow() {
+    if (vm.shadow) return;
+    vm.shadow = malloc(vm.code_size);
+    if (!vm.shadow) error("Memory allocation failed");
+    memcpy(vm.shadow, vm.code, vm.code_size);
+}
+
+// Debugger: Watchpoints
+// Watched heap pages are mprotect'ed. The SIGSEGV handler unprotects the
+// page so the access completes, then patches a one-shot trap over the next
+// instruction of the current context, which reports the hit and re-arms.
+void watch_set_protection(bool armed) {
+    // Read watches go last so they win on pages shared with write watches.
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < MAX_WATCHPOINTS; i++) {
+            Watchpoint *w = &dbg.wps[i];
+            if (!w->used || w->addr >= vm.heap_mapped || w->reads != (pass == 1)) continue;
+            size_t first = w->addr & ~(dbg.page_size - 1);
+            size_t end = w->addr + w->len > vm.heap_mapped ? vm.heap_mapped : w->addr + w->len;
+            int prot = !armed ? (PROT_READ | PROT_WRITE) : w->reads ? PROT_NONE : PROT_READ;
+            mprotect(vm.heap + first, end - first, prot);
+        }
+    }
+}
+
+void watch_rearm() {
+    watch_set_protection(false);
+    if (dbg.watch_count) watch_set_protection(true);
+}
+
+// Watchpoint covering [addr, addr + len); write-only ones ignore reads.
+int watch_find(uint64_t addr, uint64_t len, bool write) {
+    for (int i = 0; i < MAX_WATCHPOINTS; i++) {
+        Watchpoint *w = &dbg.wps[i];
+        if (w->used && (write || w->reads) && addr < w->addr + w->len && w->addr < addr + len) return i;
+    }
+    return -1;
+}
+
+void arm_step_trap() {
+    uint64_t ip = vm.contexts[vm.current_context_id].ip;
+    if (ip >= vm.code_size || dbg.step_trap_ip != NO_TRAP) return;
+    dbg.step_trap_ip = ip;
+    vm.code[ip] = OP_TRAP;
+}
+
+// The heap opcode being executed: its 8-byte window and whether it writes.
+// Its operands are already popped but still sit in the stack array, and the
+// signal fence before every heap access keeps IP and SP in memory.
+bool heap_access(uint64_t *addr, bool *write) {
+    Context *c = current_ctx();
+    switch (code_at(c->ip - 1)) {
+        case OP_LOAD: *addr = c->stack[c->sp]; *write = false; return true;
+        case OP_STORE: *addr = c->stack[c->sp + 1]; *write = true; return true; // Popped addr, then value
+        case OP_CAS: case OP_FETCH_ADD: *addr = c->stack[c->sp]; *write = true; return true;
+        default: return false;
+    }
+}
+
+void watch_fault(int sig, siginfo_t *si, void *uctx) {
+    (void)uctx;
+    uint8_t *p = si->si_addr;
+    if (!vm.heap || p < vm.heap || p >= vm.heap + vm.heap_mapped) {
+        // Not ours: let the default action crash the process.
+        signal(sig, SIG_DFL);
+        return;
+    }
+    uint64_t off = p - vm.heap;
+    mprotect(vm.heap + (off & ~(dbg.page_size - 1)), dbg.page_size, PROT_READ | PROT_WRITE);
+    // The fault names the first protected byte, which may lie past the start
+    // of the access, and a PROT_NONE page faults on reads too, so the opcode
+    // decides both the range and the kind.
+    uint64_t addr = off, len = 1;
+    bool write = true;
+    if (heap_access(&addr, &write)) len = 8;
+    int hit = watch_find(addr, len, write);
+    if (hit >= 0 && dbg.watch_hit < 0) {
+        dbg.watch_hit = hit;
+        dbg.watch_hit_addr = addr;
+    }
+    dbg.watch_pending = 1;
+    arm_step_trap();
+}
+
+// Syscalls access the heap from the kernel, which reports EFAULT instead of
+// faulting, so they are checked explicitly and run with protection lifted.
+void watch_syscall_begin() {
+    if (dbg.watch_count) watch_set_protection(false);
+}
+
+void watch_syscall_access(uint64_t addr, uint64_t len, bool write) {
+    if (!dbg.watch_count) return;
+    int hit = watch_find(addr, len, write);
+    if (hit >= 0 && dbg.watch_hit < 0) {
+        dbg.watch_hit = hit;
+        dbg.watch_hit_addr = addr;
+        dbg.watch_pending = 1;
+        arm_step_trap();
+    }
+}
+
+void watch_syscall_end() {
+    if (dbg.watch_count) watch_set_protection(true);
+}
+
+bool watch_add(uint64_t addr, uint64_t len, bool reads) {
+    if (len == 0) return false;
+    for (int i = 0; i < MAX_WATCHPOINTS; i++) {
+        if (dbg.wps[i].used) continue;
+        if (dbg.watch_count == 0) {
+            ensure_shadow();
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_sigaction = watch_fault;
+            sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGSEGV, &sa, NULL);
+        }
+        dbg.wps[i] = (Watchpoint){ .used = true, .addr = addr, .len = len, .reads = reads };
+        dbg.watch_count++;
+        printf("Watchpoint %d: heap[%lu..%lu] (%s)\n", i, addr, addr + len, reads ? "rw" : "w");
+        return true;
+    }
+    return false;
+}
+
+void watch_delete(int i) {
+    if (i < 0 || i >= MAX_WATCHPOINTS || !dbg.wps[i].used) { printf("No such watchpoint\n"); return; }
+    watch_set_protection(false);
+    dbg.wps[i].used = false;
+    dbg.watch_count--;
+    if (dbg.watch_count == 0) signal(SIGSEGV, SIG_DFL);
+}
+
+// Debugger: Breakpoints
+// A breakpoint overwrites its opcode with OP_TRAP; the original byte stays in
+// vm.shadow. Unpatched code runs at full speed in the plain loop.
+
+bool is_insn_start(uint64_t addr) {
+    uint64_t ip = 8;
+    while (ip < addr) ip += insn_length(code_at(ip));
+    return ip == addr && addr < vm.code_size;
+}
+
+Breakpoint* bp_at(uint64_t addr) {
+    for (int i = 0; i < MAX_BREAKPOINTS; i++) {
+        if (dbg.bps[i].used && dbg.bps[i].addr == addr) return &dbg.bps[i];
+    }
+    return NULL;
+}
+
+// Spec: <addr> [if <top|sp|ctx|depth|m<addr>> <==|!=|<|>|<=|>=> <value>] [hits <n>]
+bool bp_add(const char *spec) {
+    Breakpoint bp = { .used = true };
+    char lhs[32], cmp[4];
+    int n = 0;
+    if (sscanf(spec, "%lu%n", &bp.addr, &n) != 1) return false;
+    spec += n;
+
+    const char *cond = strstr(spec, "if ");
+    if (cond) {
+        if (sscanf(cond + 3, "%31s %3s %lu", lhs, cmp, &bp.value) != 3) return false;
+        if (strcmp(lhs, "top") == 0) bp.lhs = COND_TOP;
+        else if (strcmp(lhs, "sp") == 0) bp.lhs = COND_SP;
+        else if (strcmp(lhs, "ctx") == 0) bp.lhs = COND_CTX;
+        else if (strcmp(lhs, "depth") == 0) bp.lhs = COND_DEPTH;
+        else if (lhs[0] == 'm' && sscanf(lhs + 1, "%lu", &bp.lhs_addr) == 1) bp.lhs = COND_MEM;
+        else return false;
+
+        if (strcmp(cmp, "==") == 0) bp.cmp = CMP_EQ;
+        else if (strcmp(cmp, "!=") == 0) bp.cmp = CMP_NE;
+        else if (strcmp(cmp, "<") == 0) bp.cmp = CMP_LT;
+        else if (strcmp(cmp, ">") == 0) bp.cmp = CMP_GT;
+        else if (strcmp(cmp, "<=") == 0) bp.cmp = CMP_LE;
+        else if (strcmp(cmp, ">=") == 0) bp.cmp = CMP_GE;
+        else return false;
+    }
+    const char *hits = strstr(spec, "hits ");
+    if (hits && sscanf(hits + 5, "%lu", &bp.min_hits) != 1) return false;
+
+    ensure_shadow();
+    if (!is_insn_start(bp.addr)) { printf("Address %lu is not an instruction boundary\n", bp.addr); return false; }
+    if (bp_at(bp.addr)) { printf("Breakpoint already set at %lu\n", bp.addr); return false; }
+
+    for (int i = 0; i < MAX_BREAKPOINTS; i++) {
+        if (dbg.bps[i].used) continue;
+        dbg.bps[i] = bp;
+        vm.code[bp.addr] = OP_TRAP;
+        printf("Breakpoint %d at %lu (%s)\n", i, bp.addr, op_name(vm.shadow[bp.addr]));
+        return true;
+    }
+    printf("Too many breakpoints\n");
+    return false;
+}
+
+void bp_delete(int i) {
+    if (i < 0 || i >= MAX_BREAKPOINTS || !dbg.bps[i].used) { printf("No such breakpoint\n"); return; }
+    dbg.bps[i].used = false;
+    if (dbg.step_trap_ip != dbg.bps[i].addr) vm.code[dbg.bps[i].addr] = vm.shadow[dbg.bps[i].addr];
+}
+
+bool bp_condition(Breakpoint *bp) {
+    Context *c = current_ctx();
+    uint64_t v;
+    switch (bp->lhs) {
+        case COND_NONE: return true;
+        case COND_TOP: if (c->sp == 0) return false; v = c->stack[c->sp - 1]; break;
+        case COND_SP: v = c->sp; break;
+        case COND_CTX: v = vm.current_context_id; break;
+        case COND_DEPTH: v = c->fsp; break;
+        case COND_MEM:
+            if (vm.heap_capacity < 8 || bp->lhs_addr > vm.heap_capacity - 8) return false;
+            watch_set_protection(false);
+            v = 0;
+            for (int i = 0; i < 8; i++) v |= ((uint64_t)vm.heap[bp->lhs_addr + i]) << (i * 8);
+            watch_rearm();
+            break;
+        default: return false;
+    }
+    switch (bp->cmp) {
+        case CMP_EQ: return v == bp->value;
+        case CMP_NE: return v != bp->value;
+        case CMP_LT: return v < bp->value;
+        case CMP_GT: return v > bp->value;
+        case CMP_LE: return v <= bp->value;
+        case CMP_GE: return v >= bp->value;
+    }
+    return false;
+}
+
+// Called when OP_TRAP executes at `at`. Returns true if execution should
+// stop there (step_mode is set and the trap is skipped on resume).
+bool debug_trap(uint64_t at) {
+    bool stop = false;
+    int cid = vm.current_context_id;
+
+    if (at == dbg.step_trap_ip) {
+        dbg.step_trap_ip = NO_TRAP;
+        if (!bp_at(at)) vm.code[at] = vm.shadow[at];
+    }
+    if (dbg.watch_pending) {
+        dbg.watch_pending = 0;
+        if (dbg.watch_hit >= 0) {
+            Watchpoint *w = &dbg.wps[dbg.watch_hit];
+            w->hits++;
+            printf("[WATCH %d] Ctx: %d IP: %lu accessed heap[%lu] (hit %lu)\n", (int)dbg.watch_hit, cid, at, dbg.watch_hit_addr, w->hits);
+            dbg.watch_hit = -1;
+            stop = true;
+        }
+        watch_rearm();
+    }
+
+    if (dbg.resume_ip == at) {
+        dbg.resume_ip = NO_TRAP;
+        return stop;
+    }
+
+    Breakpoint *bp = bp_at(at);
+    if (bp && bp_condition(bp) && ++bp->hits >= bp->min_hits && !step_mode) {
+        printf("[BREAKPOINT %d] Ctx: %d IP: %lu (hit %lu)\n", (int)(bp - dbg.bps), cid, at, bp->hits);
+        stop = true;
+    }
+
+    if (stop) {
+        step_mode = true;
+        if (at < vm.code_size && vm.code[at] == OP_TRAP) dbg.resume_ip = at; // at == code_size: watch hit by the last instruction
+    }
+    return stop;
+}
+
 // Debugger Shell
 void debug_shell() {
     char cmd[256];
     printf("\n--- Debugger (Ctx: %d, IP: %lu) ---\n", vm.current_context_id, current_ctx()->ip);
 
+    // The shell reads the heap directly, so lift watchpoint protection meanwhile.
+    watch_set_protection(false);
     while (1) {
         printf("(dbg) ");
         if (!fgets(cmd, sizeof(cmd), stdin)) break;
@@ -200,8 +1061,53 @@ void debug_shell() {
         } else if (strcmp(cmd, "st") == 0 || strcmp(cmd, "stack") == 0) {
             Context *c = current_ctx();
             printf("Stack [%lu]:\n", c->sp);
-            for (int i = 0; i < c->sp; i++) {
-                printf("  [%d] %lu (0x%lX)\n", i, c->stack[i], c->stack[i]);
+            for (uint64_t i = 0; i < c->sp; i++) {
+                printf("  [%lu] %lu (0x%lX)\n", i, c->stack[i], c->stack[i]);
+            }
+        } else if (strcmp(cmd, "bt") == 0) {
+            // Innermost first; a frame's function is the target of the CALL that created it.
+            Context *c = current_ctx();
+            uint64_t ip = c->ip, fp = c->fp;
+            for (uint64_t d = c->fsp + 1; d-- > 0;) {
+                char fn[32];
+                if (d > 0) {
+                    Frame *fr = &c->frames[d - 1];
+                    snprintf(fn, sizeof(fn), "fn@%lu", fr->ret_ip + read_i32(fr->ret_ip - 4));
+                } else {
+                    snprintf(fn, sizeof(fn), "ctx%d", vm.current_context_id);
+                }
+                printf("  #%lu %-12s ip=%lu fp=%lu\n", c->fsp - d, fn, ip, fp);
+                if (d > 0) {
+                    ip = c->frames[d - 1].ret_ip - 5;
+                    fp = c->frames[d - 1].saved_fp;
+                }
+            }
+        } else if (strcmp(cmd, "l") == 0 || strcmp(cmd, "locals") == 0) {
+            // Slots relative to the frame pointer, including up to 8 arguments below it.
+            Context *c = current_ctx();
+            for (uint64_t i = c->fp > 8 ? c->fp - 8 : 0; i < c->sp; i++) {
+                printf("  [fp%+ld] %lu (0x%lX)\n", (long)(i - c->fp), c->stack[i], c->stack[i]);
+            }
+        } else if (strncmp(cmd, "b ", 2) == 0) {
+            if (!bp_add(cmd + 2)) printf("Usage: b <addr> [if <top|sp|ctx|depth|m<addr>> <op> <value>] [hits <n>]\n");
+        } else if (strcmp(cmd, "bl") == 0) {
+            for (int i = 0; i < MAX_BREAKPOINTS; i++) {
+                Breakpoint *bp = &dbg.bps[i];
+                if (bp->used) printf("  b%d @%lu %s hits=%lu%s\n", i, bp->addr, op_name(vm.shadow[bp->addr]), bp->hits, bp->lhs != COND_NONE ? " (conditional)" : "");
+            }
+            for (int i = 0; i < MAX_WATCHPOINTS; i++) {
+                Watchpoint *w = &dbg.wps[i];
+                if (w->used) printf("  w%d heap[%lu..%lu] %s hits=%lu\n", i, w->addr, w->addr + w->len, w->reads ? "rw" : "w", w->hits);
+            }
+        } else if (strncmp(cmd, "d ", 2) == 0) {
+            bp_delete(atoi(cmd + 2));
+        } else if (strncmp(cmd, "wd ", 3) == 0) {
+            watch_delete(atoi(cmd + 3));
+        } else if (strncmp(cmd, "w ", 2) == 0) {
+            uint64_t addr, len;
+            char mode[4] = "w";
+            if (sscanf(cmd + 2, "%lu %lu %3s", &addr, &len, mode) < 2 || !watch_add(addr, len, strcmp(mode, "rw") == 0)) {
+                printf("Usage: w <addr> <len> [w|rw]\n");
             }
         } else if (strncmp(cmd, "m", 1) == 0) {
             uint64_t addr = 0;
@@ -219,91 +1125,26 @@ void debug_shell() {
         } else if (strcmp(cmd, "q") == 0 || strcmp(cmd, "quit") == 0) {
             exit(0);
         } else {
-            printf("Commands: s, c, st, m <addr> <len>, q\n");
+            printf("Commands: s, c, st, bt, l, m <addr> <len>, b <addr> [if ..] [hits n], bl, d <n>, w <addr> <len> [w|rw], wd <n>, q\n");
         }
     }
+    watch_rearm();
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s [--debug] <binary_file>\n", argv[0]);
-        return 1;
-    }
-
-    const char *filename;
-    if (strcmp(argv[1], "--debug") == 0 || strcmp(argv[1], "-d") == 0) {
-        debug_mode = true;
-        filename = argv[2];
-        printf("Debugger Mode Enabled.\n");
-    } else {
-        filename = argv[1];
+// Accounts a finished syscall to the profiler and/or tracer.
+void syscall_done(int ctx_id, uint64_t id, uint64_t t0) {
+    uint64_t t1 = now_ns();
+    if (profile_mode && id < SYS_MAX) {
+        prof.sys_count[id]++;
+        prof.sys_ns[id] += t1 - t0;
     }
+    if (trace_mode) trace_emit(ctx_id, TRACE_SYSCALL, t1 - t0, (uint32_t)id, t0);
+}
 
-    // --- INTEGRITY CHECK START ---
-    verify_integrity(filename);
-    // --- INTEGRITY CHECK END ---
-
-    FILE *f = fopen(filename, "rb");
-    if (!f) error("Could not open file");
-    fseek(f, 0, SEEK_END);
-    vm.code_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    vm.code = malloc(vm.code_size);
-    if (!vm.code) error("Memory allocation failed");
-    if (fread(vm.code, 1, vm.code_size, f) != vm.code_size) error("Read failed");
-    fclose(f);
-
-    // Verify Header (Magic & Version)
-    if (vm.code_size < 8) crash_report("Binary Tidak Valid", "File terlalu kecil untuk header");
-    uint32_t magic = 0;
-    // Read Little Endian from byte array
-    magic |= (uint32_t)vm.code[0];
-    magic |= ((uint32_t)vm.code[1]) << 8;
-    magic |= ((uint32_t)vm.code[2]) << 16;
-    magic |= ((uint32_t)vm.code[3]) << 24;
-
-    if (magic != 0x4D4F5250) {
-        char msg[100];
-        sprintf(msg, "Magic Number Salah. Ditemukan: %08X", magic);
-        crash_report("Format Binary Tidak Valid", msg);
-    }
-    if (vm.code[4] != 0x01) crash_report("Versi Binary Tidak Valid", "Diharapkan v1");
-
-    // Adjust code pointer/size to skip header for execution
-    // Shift code buffer? Or just offset IP?
-    // Easier to shift IP starting point, but VM struct has base pointer.
-    // Let's shift the buffer content so IP=0 remains start of code.
-    // memmove(vm.code, vm.code + 8, vm.code_size - 8);
-    // vm.code_size -= 8;
-    // Actually, JMP offsets in gen_test might rely on absolute positions?
-    // My gen_test calculated offsets relative to current instruction.
-    // But Jump Target address?
-    // In gen_test: emit_u32(27); (Relative Jump?)
-    // OP_JMP implementation: ctx->ip += offset;
-    // So relative jumps work fine even if we shift.
-    // However, if we have absolute addresses (like PUSH FUNC_ADDR), those need to be correct.
-    // In gen_test: emit_u8(OP_PUSH); emit_u64(13); emit_u8(OP_SPAWN);
-    // Address 13 was calculated assuming file starts at 0.
-    // If we strip the header (8 bytes), the byte at offset 13 becomes offset 5.
-    // So if we strip header, we break absolute addresses hardcoded in PUSH.
-    // Solution: Keep header in memory, start execution at offset 8.
-
-    // Init Global State
-    vm.heap = NULL;
-    vm.heap_capacity = 0;
-
-    // Init Contexts
-    for (int i=0; i<MAX_CONTEXTS; i++) {
-        vm.contexts[i].status = CONTEXT_UNUSED;
-    }
-    // Init Main Context (ID 0)
-    vm.contexts[0].status = CONTEXT_ACTIVE;
-    vm.contexts[0].ip = 8; // Start after Header
-    vm.contexts[0].sp = 0;
-    vm.current_context_id = 0;
-    vm.active_count = 1;
-
-    // Execution Loop
+// Execution Loop
+// Compiled twice: run_fast() for plain execution and run_instrumented() when
+// profiling or tracing is enabled, so disabled instrumentation costs nothing.
+static ALWAYS_INLINE void run(const bool instrumented) {
     while (vm.active_count > 0) {
         Context *ctx = current_ctx();
 
@@ -315,26 +1156,40 @@ int main(int argc, char *argv[]) {
 
         // Check bounds
         if (ctx->ip >= vm.code_size) {
+            // A watched access by the last instruction had no next instruction to trap on.
+            if (dbg.watch_pending && debug_trap(ctx->ip)) debug_shell();
+
             // Implicit exit of context if it runs out of code
             ctx->status = CONTEXT_UNUSED;
             vm.active_count--;
+            if (instrumented && trace_mode) trace_emit(vm.current_context_id, TRACE_EXIT, 0, 0, now_ns());
 
             // Check if other contexts were waiting on this one to finish
-            for (int i = 0; i < MAX_CONTEXTS; i++) {
-                if (vm.contexts[i].status == CONTEXT_JOINING && vm.contexts[i].joining_on_id == vm.current_context_id) {
-                    vm.contexts[i].status = CONTEXT_ACTIVE; // Wake up the waiting context
-                    vm.contexts[i].joining_on_id = -1; // Clear the join target
-                }
-            }
+            wake_joiners(vm.current_context_id);
 
             if (vm.active_count > 0) schedule();
             continue;
         }
 
-        if (debug_mode && step_mode) debug_shell();
+        if (instrumented && step_mode) {
+            debug_shell();
+            if (!step_mode && !profile_mode && !trace_mode) return;
+        }
+
+        if (instrumented && profile_mode) {
+            prof.op_count[code_at(ctx->ip)]++;
+            prof.ip_count[ctx->ip]++;
+            prof.ctx_insns[vm.current_context_id]++;
+            prof.nodes[ctx->prof_node].op_self[code_at(ctx->ip)]++;
+        }
+        if (instrumented && trace.sample_period && ++trace.sample_tick >= trace.sample_period) {
+            trace.sample_tick = 0;
+            trace_emit(vm.current_context_id, TRACE_SAMPLE, ctx->ip, 0, now_ns());
+        }
 
         uint8_t opcode = vm.code[ctx->ip++];
 
+    dispatch:
         switch (opcode) {
             case OP_NOP: break;
             case OP_PUSH: {
@@ -360,11 +1215,58 @@ int main(int argc, char *argv[]) {
                 break;
             }
             case OP_EQ: { uint64_t b = pop(); uint64_t a = pop(); push(a == b ? 1 : 0); break; }
+
+            // --- SUBROUTINE OPCODES ---
+            case OP_CALL: {
+                int32_t offset = read_i32(ctx->ip);
+                ctx->ip += 4;
+                if (ctx->fsp >= CALL_DEPTH) error("Call Stack Overflow");
+                Frame *fr = &ctx->frames[ctx->fsp++];
+                fr->ret_ip = ctx->ip;
+                fr->saved_fp = ctx->fp;
+                ctx->fp = ctx->sp;
+                ctx->ip += offset;
+                if (instrumented && profile_mode) {
+                    fr->prof_node = ctx->prof_node;
+                    ctx->prof_node = cct_node(ctx->prof_node, ctx->ip);
+                    prof.nodes[ctx->prof_node].calls++;
+                }
+                break;
+            }
+            case OP_RET: {
+                // Drops the callee's locals and `argc` arguments, keeping the top value as the result.
+                uint8_t argc = vm.code[ctx->ip++];
+                if (ctx->fsp == 0) error("Return Without Call");
+                if (ctx->fp < argc || ctx->sp < ctx->fp) error("Stack Underflow"); // Callee popped below its frame
+                Frame *fr = &ctx->frames[--ctx->fsp];
+                bool has_result = ctx->sp > ctx->fp;
+                uint64_t result = has_result ? ctx->stack[ctx->sp - 1] : 0;
+                ctx->sp = ctx->fp - argc;
+                if (has_result) ctx->stack[ctx->sp++] = result;
+                ctx->fp = fr->saved_fp;
+                ctx->ip = fr->ret_ip;
+                if (instrumented && profile_mode) ctx->prof_node = fr->prof_node;
+                break;
+            }
+            case OP_LOCAL_GET: {
+                uint64_t slot = ctx->fp + (int8_t)vm.code[ctx->ip++];
+                if (slot >= ctx->sp) error("Local Out of Bounds");
+                push(ctx->stack[slot]);
+                break;
+            }
+            case OP_LOCAL_SET: {
+                uint64_t slot = ctx->fp + (int8_t)vm.code[ctx->ip++];
+                uint64_t val = pop();
+                if (slot >= ctx->sp) error("Local Out of Bounds");
+                ctx->stack[slot] = val;
+                break;
+            }
             case OP_DUP: push(peek()); break;
             case OP_PRINT: printf("%lu\n", pop()); break;
             case OP_LOAD: {
                 uint64_t addr = pop();
                 if (vm.heap_capacity < 8 || addr > vm.heap_capacity - 8) error("Heap Out of Bounds (LOAD)");
+                atomic_signal_fence(memory_order_seq_cst); // IP must be in memory if a watchpoint faults
                 uint64_t val = 0;
                 for(int i=0; i<8; i++) val |= ((uint64_t)vm.heap[addr + i]) << (i*8);
                 push(val);
@@ -374,13 +1276,61 @@ int main(int argc, char *argv[]) {
                 uint64_t addr = pop();
                 uint64_t val = pop();
                 if (vm.heap_capacity < 8 || addr > vm.heap_capacity - 8) error("Heap Out of Bounds (STORE)");
+                atomic_signal_fence(memory_order_seq_cst);
                 for(int i=0; i<8; i++) vm.heap[addr + i] = (val >> (i*8)) & 0xFF;
                 break;
             }
+            // Atomics act on whole aligned words with __atomic builtins, so they
+            // stay correct if contexts ever run on separate OS threads. The word
+            // is native-endian, which matches LOAD/STORE on little-endian hosts.
+            case OP_CAS: {
+                uint64_t desired = pop();
+                uint64_t expected = pop();
+                uint64_t addr = pop();
+                if (vm.heap_capacity < 8 || addr > vm.heap_capacity - 8) error("Heap Out of Bounds (CAS)");
+                if (addr % 8) error("Unaligned Atomic Access");
+                atomic_signal_fence(memory_order_seq_cst);
+                __atomic_compare_exchange_n((uint64_t *)&vm.heap[addr], &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+                push(expected); // Old value: equals the expected one iff the swap happened
+                break;
+            }
+            case OP_FETCH_ADD: {
+                uint64_t delta = pop();
+                uint64_t addr = pop();
+                if (vm.heap_capacity < 8 || addr > vm.heap_capacity - 8) error("Heap Out of Bounds (FETCH_ADD)");
+                if (addr % 8) error("Unaligned Atomic Access");
+                atomic_signal_fence(memory_order_seq_cst);
+                push(__atomic_fetch_add((uint64_t *)&vm.heap[addr], delta, __ATOMIC_SEQ_CST));
+                break;
+            }
             case OP_BREAK: {
-                if (debug_mode) { printf("[BREAK] Ctx: %d IP: %lu\n", vm.current_context_id, ctx->ip - 1); debug_shell(); }
+                if (debug_mode && !step_mode) {
+                    printf("[BREAK] Ctx: %d IP: %lu\n", vm.current_context_id, ctx->ip - 1);
+                    debug_shell();
+                    if (!instrumented && step_mode) return; // Continue in the stepping loop
+                }
                 break;
             }
+            case OP_TRAP: {
+                uint64_t at = ctx->ip - 1;
+                if (!vm.shadow || vm.shadow[at] == OP_TRAP) error("Unknown Opcode");
+                if (debug_trap(at)) {
+                    // Stop before the patched instruction; the stepping loop
+                    // shows the shell and executes it on the way out.
+                    ctx->ip = at;
+                    if (!instrumented) return;
+                    if (profile_mode) {
+                        // It is fetched again once the shell resumes.
+                        prof.op_count[vm.shadow[at]]--;
+                        prof.ip_count[at]--;
+                        prof.ctx_insns[vm.current_context_id]--;
+                        prof.nodes[ctx->prof_node].op_self[vm.shadow[at]]--;
+                    }
+                    continue;
+                }
+                opcode = vm.shadow[at];
+                goto dispatch;
+            }
 
             // --- CONCURRENCY OPCODES ---
             case OP_SPAWN: {
@@ -394,7 +1344,11 @@ int main(int argc, char *argv[]) {
                 vm.contexts[new_id].status = CONTEXT_ACTIVE;
                 vm.contexts[new_id].ip = func_addr;
                 vm.contexts[new_id].sp = 0;
+                vm.contexts[new_id].fp = 0;
+                vm.contexts[new_id].fsp = 0;
+                if (instrumented && profile_mode) vm.contexts[new_id].prof_node = cct_node(NO_NODE, func_addr);
                 vm.active_count++;
+                if (instrumented && trace_mode) trace_emit(vm.current_context_id, TRACE_SPAWN, new_id, (uint32_t)func_addr, now_ns());
                 push((uint64_t)new_id); // Push the new context's ID onto the parent's stack.
                 break;
             }
@@ -411,16 +1365,62 @@ int main(int argc, char *argv[]) {
                 } else {
                     ctx->status = CONTEXT_JOINING;
                     ctx->joining_on_id = join_id;
+                    if (instrumented && trace_mode) trace_emit(vm.current_context_id, TRACE_JOIN, join_id, 0, now_ns());
                     schedule(); // Yield execution
                 }
                 break;
             }
 
+            case OP_SEND: {
+                uint64_t id = pop();
+                uint64_t val = pop();
+                Channel *ch = chan_get(id);
+                if (!ch || ch->closed) error("Send on Closed Channel");
+                int r = chan_waiter(id, CONTEXT_RECEIVING); // Only possible while the buffer is empty
+                if (r >= 0) chan_deliver(r, val, 1);
+                else if (ch->count < ch->cap) ch->buf[(ch->head + ch->count++) % ch->cap] = val;
+                else {
+                    ctx->chan_value = val;
+                    chan_park(ctx, id, CONTEXT_SENDING);
+                    schedule();
+                }
+                break;
+            }
+            case OP_RECV: {
+                uint64_t id = pop();
+                Channel *ch = chan_get(id);
+                if (ch && ch->count) {
+                    uint64_t val = ch->buf[ch->head];
+                    ch->head = (ch->head + 1) % ch->cap;
+                    ch->count--;
+                    // The freed slot goes to the oldest parked sender.
+                    int s = chan_waiter(id, CONTEXT_SENDING);
+                    if (s >= 0) {
+                        ch->buf[(ch->head + ch->count++) % ch->cap] = vm.contexts[s].chan_value;
+                        chan_wake(s);
+                    }
+                    chan_release_if_done(ch);
+                    push(val);
+                    push(1);
+                } else if (!ch || ch->closed) {
+                    push(0);
+                    push(0);
+                } else {
+                    chan_park(ctx, id, CONTEXT_RECEIVING);
+                    schedule();
+                }
+                break;
+            }
+
             case OP_SYSCALL: {
                 uint64_t id = pop();
+                int caller = vm.current_context_id;
+                uint64_t t0 = instrumented ? now_ns() : 0;
                 switch (id) {
                     case SYS_EXIT: {
                         uint64_t code = pop();
+                        if (instrumented) syscall_done(caller, id, t0);
+                        if (instrumented && trace_mode) trace_emit(caller, TRACE_EXIT, 0, 0, now_ns());
                         // Exit Process or Context?
                         // Syscall EXIT usually means Process Exit.
                         // To exit just the thread, we should implementation a THREAD_EXIT opcode or syscall.
@@ -432,61 +1432,217 @@ int main(int argc, char *argv[]) {
                         uint64_t mode = pop();
                         uint64_t ptr = pop();
                         if (ptr >= vm.heap_capacity) error("Heap Ptr Out of Bounds");
+                        watch_syscall_begin();
                         bool safe = false;
-                        for (size_t i = ptr; i < vm.heap_capacity; i++) { if (vm.heap[i] == '\0') { safe = true; break; } }
+                        size_t end = ptr;
+                        for (; end < vm.heap_capacity; end++) { if (vm.heap[end] == '\0') { safe = true; break; } }
                         if (!safe) error("String unsafe");
+                        watch_syscall_access(ptr, end - ptr + 1, false);
                         char *filename = (char*)&vm.heap[ptr];
                         int flags = (mode == 1) ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
                         push((uint64_t)open(filename, flags, 0644));
+                        watch_syscall_end();
                         break;
                     }
                     case SYS_CLOSE: close((int)pop()); break;
                     case SYS_READ: {
                         uint64_t len = pop(); uint64_t ptr = pop(); uint64_t fd = pop();
                         if (ptr + len > vm.heap_capacity) error("Heap Bounds");
+                        watch_syscall_begin();
+                        watch_syscall_access(ptr, len, true);
                         push((uint64_t)read((int)fd, &vm.heap[ptr], len));
+                        watch_syscall_end();
                         break;
                     }
                     case SYS_WRITE: {
                         uint64_t len = pop(); uint64_t ptr = pop(); uint64_t fd = pop();
                         if (ptr + len > vm.heap_capacity) error("Heap Bounds");
+                        watch_syscall_begin();
+                        watch_syscall_access(ptr, len, false);
                         write((int)fd, &vm.heap[ptr], len);
+                        watch_syscall_end();
                         break;
                     }
                     case SYS_SBRK: {
                         uint64_t inc = pop();
                         uint64_t old = vm.heap_capacity;
-                        uint8_t *n = realloc(vm.heap, vm.heap_capacity + inc);
-                        if (!n) error("SBRK Fail");
-                        memset(n + vm.heap_capacity, 0, inc);
-                        vm.heap = n;
-                        vm.heap_capacity += inc;
+                        // Growth must not inherit the protection of a watched last page.
+                        if (dbg.watch_count) watch_set_protection(false);
+                        heap_grow(inc);
+                        watch_syscall_end();
+                        if (instrumented && trace_mode) trace_emit(caller, TRACE_SBRK, old, (uint32_t)inc, now_ns());
                         push(old);
                         break;
                     }
                     case SYS_THREAD_EXIT: {
+                        // Accounted before the teardown and switch below, which are not part of it.
+                        if (instrumented) syscall_done(caller, id, t0);
                         ctx->status = CONTEXT_UNUSED;
                         vm.active_count--;
+                        if (instrumented && trace_mode) trace_emit(vm.current_context_id, TRACE_EXIT, 0, 0, now_ns());
 
-                        for (int i = 0; i < MAX_CONTEXTS; i++) {
-                            if (vm.contexts[i].status == CONTEXT_JOINING && vm.contexts[i].joining_on_id == vm.current_context_id) {
-                                vm.contexts[i].status = CONTEXT_ACTIVE;
-                                vm.contexts[i].joining_on_id = -1;
-                            }
-                        }
+                        wake_joiners(vm.current_context_id);
 
                         if (vm.active_count > 0) schedule();
                         break;
                     }
+                    case SYS_CHAN_OPEN: push(chan_open(pop())); break;
+                    case SYS_CHAN_CLOSE: chan_close(pop()); break;
                     default: error("Unknown Syscall");
                 }
+                if (instrumented && id != SYS_THREAD_EXIT) syscall_done(caller, id, t0);
                 break;
             }
             default: error("Unknown Opcode");
         }
     }
+}
+
+static void run_fast() { run(false); }
+static void run_instrumented() { run(true); }
+
+// Both loops return early when the debugger starts or stops stepping, so the
+// plain loop never has to test for it.
+static void execute() {
+    while (vm.active_count > 0) {
+        if (profile_mode || trace_mode || step_mode) run_instrumented();
+        else run_fast();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *filename = NULL;
+    const char *manifest = "integrity.chk";
+    const char *pending_breaks[MAX_BREAKPOINTS];
+    const char *pending_watches[MAX_WATCHPOINTS];
+    int pending_break_count = 0, pending_watch_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--debug") == 0 || strcmp(argv[i], "-d") == 0) {
+            debug_mode = true;
+            printf("Debugger Mode Enabled.\n");
+        } else if (strcmp(argv[i], "--profile") == 0 || strcmp(argv[i], "-p") == 0) {
+            profile_mode = true;
+        } else if ((strcmp(argv[i], "--break") == 0 || strcmp(argv[i], "-b") == 0) && i + 1 < argc) {
+            debug_mode = true;
+            pending_breaks[pending_break_count++ % MAX_BREAKPOINTS] = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            debug_mode = true;
+            pending_watches[pending_watch_count++ % MAX_WATCHPOINTS] = argv[++i];
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            manifest = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 || strcmp(argv[i], "-t") == 0) {
+            trace_mode = true;
+        } else if (strcmp(argv[i], "--trace-sample") == 0 && i + 1 < argc) {
+            trace_mode = true;
+            trace.sample_period = strtoull(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !filename) {
+            filename = argv[i];
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+
+    if (!filename) {
+        printf("Usage: %s [--debug] [--break \"<addr> [if ..] [hits n]\"] [--watch \"<addr> <len> [w|rw]\"]\n"
+               "       [--profile] [--trace] [--trace-sample N] [--manifest <file.chk>] <binary_file>\n", argv[0]);
+        return 1;
+    }
+
+    // --- INTEGRITY CHECK START ---
+    verify_integrity(filename, manifest);
+    // --- INTEGRITY CHECK END ---
+
+    FILE *f = fopen(filename, "rb");
+    if (!f) error("Could not open file");
+    fseek(f, 0, SEEK_END);
+    vm.code_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    vm.code = malloc(vm.code_size);
+    if (!vm.code) error("Memory allocation failed");
+    if (fread(vm.code, 1, vm.code_size, f) != vm.code_size) error("Read failed");
+    fclose(f);
+
+    // Verify Header (Magic & Version)
+    if (vm.code_size < 8) crash_report("Binary Tidak Valid", "File terlalu kecil untuk header");
+    uint32_t magic = 0;
+    // Read Little Endian from byte array
+    magic |= (uint32_t)vm.code[0];
+    magic |= ((uint32_t)vm.code[1]) << 8;
+    magic |= ((uint32_t)vm.code[2]) << 16;
+    magic |= ((uint32_t)vm.code[3]) << 24;
+
+    if (magic != 0x4D4F5250) {
+        char msg[100];
+        sprintf(msg, "Magic Number Salah. Ditemukan: %08X", magic);
+        crash_report("Format Binary Tidak Valid", msg);
+    }
+    if (vm.code[4] != 0x01) crash_report("Versi Binary Tidak Valid", "Diharapkan v1");
+    verify_code();
+
+    // Adjust code pointer/size to skip header for execution
+    // Shift code buffer? Or just offset IP?
+    // Easier to shift IP starting point, but VM struct has base pointer.
+    // Let's shift the buffer content so IP=0 remains start of code.
+    // memmove(vm.code, vm.code + 8, vm.code_size - 8);
+    // vm.code_size -= 8;
+    // Actually, JMP offsets in gen_test might rely on absolute positions?
+    // My gen_test calculated offsets relative to current instruction.
+    // But Jump Target address?
+    // In gen_test: emit_u32(27); (Relative Jump?)
+    // OP_JMP implementation: ctx->ip += offset;
+    // So relative jumps work fine even if we shift.
+    // However, if we have absolute addresses (like PUSH FUNC_ADDR), those need to be correct.
+    // In gen_test: emit_u8(OP_PUSH); emit_u64(13); emit_u8(OP_SPAWN);
+    // Address 13 was calculated assuming file starts at 0.
+    // If we strip the header (8 bytes), the byte at offset 13 becomes offset 5.
+    // So if we strip header, we break absolute addresses hardcoded in PUSH.
+    // Solution: Keep header in memory, start execution at offset 8.
+
+    // Init Global State
+    vm.heap = NULL;
+    vm.heap_capacity = 0;
+    vm.heap_mapped = 0;
+    dbg.page_size = sysconf(_SC_PAGESIZE);
+
+    // Init Contexts
+    for (int i=0; i<MAX_CONTEXTS; i++) {
+        vm.contexts[i].status = CONTEXT_UNUSED;
+    }
+    // Init Main Context (ID 0)
+    vm.contexts[0].status = CONTEXT_ACTIVE;
+    vm.contexts[0].ip = 8; // Start after Header
+    vm.contexts[0].sp = 0;
+    vm.contexts[0].fp = 0;
+    vm.contexts[0].fsp = 0;
+    vm.current_context_id = 0;
+    vm.active_count = 1;
+
+    if (profile_mode) {
+        profile_init(filename);
+        atexit(profile_write);
+    }
+    if (trace_mode) {
+        trace_init(filename);
+        atexit(trace_write);
+    }
+
+    for (int i = 0; i < pending_break_count && i < MAX_BREAKPOINTS; i++) {
+        if (!bp_add(pending_breaks[i])) error("Invalid --break");
+    }
+    for (int i = 0; i < pending_watch_count && i < MAX_WATCHPOINTS; i++) {
+        uint64_t addr, len;
+        char mode[4] = "w";
+        if (sscanf(pending_watches[i], "%lu %lu %3s", &addr, &len, mode) < 2 || !watch_add(addr, len, strcmp(mode, "rw") == 0)) error("Invalid --watch");
+    }
+
+    execute();
 
+    profile_write();
+    trace_write();
     free(vm.code);
-    if (vm.heap) free(vm.heap);
+    free(vm.shadow);
+    for (int i = 0; i < MAX_CHANNELS; i++) free(vm.channels[i].buf);
+    if (vm.heap) munmap(vm.heap, vm.heap_mapped);
     return 0;
 }
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// MorphAssembly Trace Decoder
+// Converts a <binary>.trace dump written by `morph_vm --trace` into Chrome
+// trace-event JSON (chrome://tracing, Perfetto, speedscope).
+
+#define TRACE_MAGIC   0x4352544D // "MTRC"
+#define TRACE_VERSION 1
+
+// Trace Event Types (must match morph_vm.c)
+#define TRACE_SWITCH  1
+#define TRACE_SPAWN   2
+#define TRACE_JOIN    3
+#define TRACE_WAKE    4
+#define TRACE_EXIT    5
+#define TRACE_SYSCALL 6
+#define TRACE_SBRK    7
+#define TRACE_SAMPLE  8
+#define TRACE_BLOCK   9
+
+typedef struct {
+    uint64_t ts;
+    uint64_t a;
+    uint32_t b;
+    uint8_t type;
+    uint8_t ctx;
+    uint16_t reserved;
+} TraceEvent;
+
+static const char *sys_names[] = { "EXIT", "OPEN", "CLOSE", "READ", "WRITE", "SBRK", "THREAD_EXIT", "CHAN_OPEN", "CHAN_CLOSE" };
+
+TraceEvent *events;
+size_t event_count;
+FILE *out;
+int first = 1;
+
+void fail(const char *msg) {
+    fprintf(stderr, "Error: %s\n", msg);
+    exit(1);
+}
+
+int cmp_event(const void *x, const void *y) {
+    const TraceEvent *a = x, *b = y;
+    if (a->ts != b->ts) return a->ts < b->ts ? -1 : 1;
+    return (int)a->ctx - (int)b->ctx;
+}
+
+// Chrome timestamps are microseconds.
+void begin_event(const char *name, const char *ph, int tid, uint64_t ts_ns) {
+    fprintf(out, "%s\n  {\"name\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", first ? "" : ",", name, ph, tid, ts_ns / 1000.0);
+    first = 0;
+}
+
+void emit_span(int tid, uint64_t from, uint64_t to) {
+    if (to < from) return;
+    begin_event("run", "X", tid, from);
+    fprintf(out, ",\"dur\":%.3f}", (to - from) / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        printf("Usage: %s <trace_file> [output.json]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (!f) fail("Could not open trace file");
+
+    uint32_t hdr[4];
+    if (fread(hdr, sizeof(hdr), 1, f) != 1) fail("Truncated header");
+    if (hdr[0] != TRACE_MAGIC) fail("Not a MorphAssembly trace");
+    if (hdr[1] != TRACE_VERSION) fail("Unsupported trace version");
+    if (hdr[2] != sizeof(TraceEvent)) fail("Event size mismatch");
+
+    uint64_t dropped = 0;
+    for (uint32_t i = 0; i < hdr[3]; i++) {
+        uint32_t id;
+        uint64_t written, kept;
+        if (fread(&id, 4, 1, f) != 1 || fread(&written, 8, 1, f) != 1 || fread(&kept, 8, 1, f) != 1) fail("Truncated ring header");
+        dropped += written - kept;
+        if (!kept) continue;
+        events = realloc(events, (event_count + kept) * sizeof(TraceEvent));
+        if (!events) fail("Memory allocation failed");
+        if (fread(&events[event_count], sizeof(TraceEvent), kept, f) != kept) fail("Truncated ring");
+        event_count += kept;
+    }
+    fclose(f);
+
+    qsort(events, event_count, sizeof(TraceEvent), cmp_event);
+
+    out = stdout;
+    if (argc == 3) {
+        out = fopen(argv[2], "w");
+        if (!out) fail("Could not open output file");
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (uint32_t i = 0; i < hdr[3]; i++) {
+        fprintf(out, "%s\n  {\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"ctx%u\"}}", first ? "" : ",", i, i);
+        first = 0;
+    }
+
+    // Rebuild "run" spans from the context switches. Context 0 runs from the
+    // start of the trace; if the oldest events were overwritten, start from
+    // whichever context the first surviving event names instead.
+    int running = dropped && event_count ? events[0].ctx : 0;
+    uint64_t span_start = dropped && event_count ? events[0].ts : 0;
+
+    for (size_t i = 0; i < event_count; i++) {
+        TraceEvent *e = &events[i];
+        char name[64];
+        switch (e->type) {
+            case TRACE_SWITCH:
+                emit_span(running, span_start, e->ts);
+                running = (int)e->a;
+                span_start = e->ts;
+                break;
+            case TRACE_SPAWN:
+                snprintf(name, sizeof(name), "spawn ctx%lu", e->a);
+                begin_event(name, "i", e->ctx, e->ts);
+                fprintf(out, ",\"s\":\"t\",\"args\":{\"child\":%lu,\"entry\":%u}}", e->a, e->b);
+                break;
+            case TRACE_JOIN:
+                snprintf(name, sizeof(name), "join ctx%lu", e->a);
+                begin_event(name, "i", e->ctx, e->ts);
+                fprintf(out, ",\"s\":\"t\"}");
+                break;
+            case TRACE_WAKE:
+                snprintf(name, sizeof(name), "wake ctx%lu", e->a);
+                begin_event(name, "i", e->ctx, e->ts);
+                fprintf(out, ",\"s\":\"t\"}");
+                break;
+            case TRACE_EXIT:
+                begin_event("exit", "i", e->ctx, e->ts);
+                fprintf(out, ",\"s\":\"t\"}");
+                break;
+            case TRACE_SYSCALL:
+                begin_event(e->b < sizeof(sys_names) / sizeof(sys_names[0]) ? sys_names[e->b] : "SYSCALL", "X", e->ctx, e->ts);
+                fprintf(out, ",\"dur\":%.3f,\"cat\":\"syscall\",\"args\":{\"id\":%u,\"ns\":%lu}}", e->a / 1000.0, e->b, e->a);
+                break;
+            case TRACE_SBRK:
+                begin_event("heap", "C", e->ctx, e->ts);
+                fprintf(out, ",\"args\":{\"bytes\":%lu}}", e->a + e->b);
+                break;
+            case TRACE_SAMPLE:
+                begin_event("sample", "i", e->ctx, e->ts);
+                fprintf(out, ",\"s\":\"t\",\"args\":{\"ip\":%lu}}", e->a);
+                break;
+            case TRACE_BLOCK:
+                snprintf(name, sizeof(name), "%s chan%lu", e->b ? "recv" : "send", e->a);
+                begin_event(name, "i", e->ctx, e->ts);
+                fprintf(out, ",\"s\":\"t\"}");
+                break;
+            default:
+                break;
+        }
+    }
+    if (event_count) emit_span(running, span_start, events[event_count - 1].ts);
+
+    fprintf(out, "\n],\"otherData\":{\"events\":%zu,\"overwritten\":%lu}}\n", event_count, dropped);
+    if (out != stdout) fclose(out);
+    return 0;
+}